@@ -0,0 +1,64 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "map_generator.hpp"
+#include "wad.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace BenchMaps {
+    // The number of linedefs in each of the maps, for every topology
+    inline const std::vector<std::int64_t> sizes = { 100, 1000, 10000, 30000, 60000 };
+    inline const std::vector<std::int64_t> topologies = { 0, 1, 2, 3, 4 };
+
+    inline std::string name(std::int64_t topology, std::int64_t linedefs) {
+        std::size_t size = 0;
+        while (size + 1 < sizes.size() && sizes[size] < linedefs)
+            size++;
+
+        auto index = topology * sizes.size() + size + 1;
+        return (index < 10 ? "MAP0" : "MAP") + std::to_string(index);
+    }
+
+    /**
+     * Gets the WAD with all of the benchmark maps in it, generating it the first time
+     * @return The path of the WAD, in the temporary directory
+     */
+    inline const std::string &path() {
+        static const std::string path = [] {
+            auto path = (std::filesystem::temp_directory_path() / "nodebuilder_bench.wad").string();
+
+            Wad wad;
+            for (auto topology : topologies) {
+                for (auto linedefs : sizes) {
+                    auto generator = MapGenerator::generate(static_cast<MapGenerator::Topology>(topology), linedefs);
+                    generator.write(wad, name(topology, linedefs));
+                }
+            }
+
+            if (!wad.save(path))
+                throw std::runtime_error("Unable to write " + path);
+
+            return path;
+        }();
+
+        return path;
+    }
+}
@@ -0,0 +1,93 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "bench_maps.hpp"
+#include "blockmap.hpp"
+#include "bsp.hpp"
+#include "map.hpp"
+#include "thread_pool.hpp"
+#include <benchmark/benchmark.h>
+#include <memory>
+
+namespace {
+    benchmark::Counter rate(const benchmark::State &state, std::size_t count) {
+        return benchmark::Counter(static_cast<double>(state.iterations() * count), benchmark::Counter::kIsRate);
+    }
+}
+
+// Arguments are the topology of the map, the number of linedefs, and the number of threads
+static void BM_BspBuild(benchmark::State &state) {
+    Wad wad(BenchMaps::path());
+    state.SetLabel(MapGenerator::topology_name(static_cast<MapGenerator::Topology>(state.range(0))));
+
+    std::unique_ptr<ThreadPool> pool;
+    if (state.range(2) > 1)
+        pool = std::make_unique<ThreadPool>(state.range(2));
+
+    std::size_t segs = 0, linedefs = 0;
+
+    for (auto _ : state) {
+        // Start from the original map each time, as saving replaces the vertices and linedefs
+        state.PauseTiming();
+        Map map(BenchMaps::name(state.range(0), state.range(1)), wad);
+        map.load();
+        state.ResumeTiming();
+
+        Bsp bsp(map);
+        bsp.build(pool.get());
+        bsp.save();
+
+        // Big maps get extended nodes, which leave SEGS empty, so the count comes from the tree
+        segs     = bsp.stats().segs;
+        linedefs = map.num_linedefs();
+    }
+
+    if (!segs) {
+        state.SkipWithError("No segs were built");
+        return;
+    }
+
+    state.counters["segs/s"]     = rate(state, segs);
+    state.counters["linedefs/s"] = rate(state, linedefs);
+    state.counters["linedefs"]   = linedefs;
+}
+
+static void BM_BlockMapBuild(benchmark::State &state) {
+    Wad wad(BenchMaps::path());
+    state.SetLabel(MapGenerator::topology_name(static_cast<MapGenerator::Topology>(state.range(0))));
+
+    Map map(BenchMaps::name(state.range(0), state.range(1)), wad);
+    map.load();
+
+    for (auto _ : state) {
+        BlockMap blockmap(map);
+        blockmap.build();
+        blockmap.save();
+    }
+
+    state.counters["linedefs/s"] = rate(state, map.num_linedefs());
+    state.counters["linedefs"]   = map.num_linedefs();
+}
+
+BENCHMARK(BM_BspBuild)
+    ->ArgsProduct({ BenchMaps::topologies, BenchMaps::sizes, { 1, 4 } })
+    ->ArgNames({ "topology", "linedefs", "threads" })
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_BlockMapBuild)
+    ->ArgsProduct({ BenchMaps::topologies, BenchMaps::sizes })
+    ->ArgNames({ "topology", "linedefs" })
+    ->Unit(benchmark::kMillisecond);
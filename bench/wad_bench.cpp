@@ -0,0 +1,47 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "bench_maps.hpp"
+#include "map.hpp"
+#include <benchmark/benchmark.h>
+#include <filesystem>
+
+// Opens the WAD, loads every map and writes it all back out, without building anything
+static void BM_WadLoadSave(benchmark::State &state) {
+    auto output = (std::filesystem::temp_directory_path() / "nodebuilder_bench_out.wad").string();
+    std::size_t linedefs = 0;
+
+    for (auto _ : state) {
+        Wad wad(BenchMaps::path());
+        linedefs = 0;
+
+        for (const auto &name : wad.maps()) {
+            Map map(name, wad);
+            map.load();
+            map.save();
+
+            linedefs += map.num_linedefs();
+        }
+
+        if (!wad.save(output))
+            state.SkipWithError("Unable to write the WAD");
+    }
+
+    state.counters["linedefs/s"] = benchmark::Counter(static_cast<double>(state.iterations() * linedefs), benchmark::Counter::kIsRate);
+
+    std::filesystem::remove(output);
+}
+
+BENCHMARK(BM_WadLoadSave)->Unit(benchmark::kMillisecond);
@@ -16,33 +16,20 @@
 #include "blockmap.hpp"
 #include "box.hpp"
 #include "common.hpp"
-#include "renderer.hpp"
+#include "build_observer.hpp"
 
 BlockMap::BlockMap(Map &map) : map_(map) {
     width  = (map_.size().x + block_size - 1) / block_size;
     height = (map_.size().y + block_size - 1) / block_size;
 }
 
-void BlockMap::build(Renderer &renderer) {
-    int block_count = 0;
-
-    // Generate the blocks
-    for (int y = height-1; y >= 0; y--) {
-        for (int x = 0; x < width; x++) {
-            if (!renderer.running())
-                return;
+void BlockMap::build(BuildObserver *observer) {
+    NullObserver null_observer;
 
-            if (gen(x, y, renderer)) {
-                // Draw some stats
-                renderer.draw_text(
-                    std::string("Building Blockmap...") +
-                    "\nBlocks processed: " + std::to_string(block_count++)
-                );
-
-                renderer.show(60.0f);
-            }
-        }
-    }
+    if (observer)
+        generate(*observer);
+    else
+        generate(null_observer);
 }
 
 void BlockMap::save() {
@@ -74,29 +61,23 @@ void BlockMap::save() {
     map_.replace_blockmap(&data[0], data.size());
 }
 
-bool BlockMap::gen(unsigned int x, unsigned int y, Renderer &renderer) {
-    // Draw a grid representing the block map
-    auto draw_grid = [&]() {
-        renderer.clear();
-        const Color color(0x20, 0x20, 0x20);
-
-        // Draw the horizontal lines
-        Vec2f pos(map_.offset().x, map_.offset().y);
-        for (auto y = 0; y <= height; y++) {
-            renderer.draw_line(Linef(pos, pos + Vec2f(map_.size().x, 0.0f)), color);
-            pos.y += block_size;
-        }
+template <typename Observer>
+void BlockMap::generate(Observer &observer) {
+    int block_count = 0;
 
-        // Draw the vertical lines
-        pos = Vec2f(map_.offset().x, map_.offset().y);
-        for (auto x = 0; x <= width; x++) {
-            renderer.draw_line(Linef(pos, pos + Vec2f(0.0f, map_.size().y)), color);
-            pos.x += block_size;
-        }
+    // Generate the blocks
+    for (int y = height-1; y >= 0; y--) {
+        for (unsigned int x = 0; x < width; x++) {
+            if (!observer.running())
+                return;
 
-        renderer.draw_map_outline();
-    };
+            gen(x, y, observer, block_count);
+        }
+    }
+}
 
+template <typename Observer>
+void BlockMap::gen(unsigned int x, unsigned int y, Observer &observer, int &block_count) {
     // Create a bounding box for this block
     auto box = Boxf(
         Vec2f(map_.offset().x + x*block_size, map_.offset().y + y*block_size),
@@ -109,7 +90,7 @@ bool BlockMap::gen(unsigned int x, unsigned int y, Renderer &renderer) {
     List list;
 
     // Look at each linedef
-    for (auto i = 0; i < map_.num_linedefs(); i++) {
+    for (std::size_t i = 0; i < map_.num_linedefs(); i++) {
         auto p1 = Vec2f(vertices[linedefs[i].start].x, vertices[linedefs[i].start].y);
         auto p2 = Vec2f(vertices[linedefs[i].end].x, vertices[linedefs[i].end].y);
 
@@ -121,24 +102,22 @@ bool BlockMap::gen(unsigned int x, unsigned int y, Renderer &renderer) {
     // Add the list
     lists[list].push_back(y*width + x);
 
-    if (renderer.drawing()) {
-        if (list.size()) {
-            draw_grid();
-            const auto color = Color::random();
+    if (list.empty())
+        return;
 
-            // Draw the lines that are inside the box
-            for (const auto &i : list) {
-                auto p1 = Vec2f(vertices[linedefs[i].start].x, vertices[linedefs[i].start].y);
-                auto p2 = Vec2f(vertices[linedefs[i].end].x, vertices[linedefs[i].end].y);
+    if constexpr (Observer::active) {
+        std::vector<Linef> lines;
 
-                auto line = box.clip(Linef(p1, p2));
-                renderer.add_line(line, color);
-            }
+        // Find the parts of the lines that are inside the box
+        for (const auto &i : list) {
+            auto p1 = Vec2f(vertices[linedefs[i].start].x, vertices[linedefs[i].start].y);
+            auto p2 = Vec2f(vertices[linedefs[i].end].x, vertices[linedefs[i].end].y);
 
-            renderer.draw_box(box);
-            return true;
+            lines.push_back(box.clip(Linef(p1, p2)));
         }
+
+        observer.block_created(box, lines, block_count);
     }
 
-    return false;
+    block_count++;
 }
@@ -19,16 +19,19 @@
 #include <vector>
 #include <map>
 
-class Renderer;
+class BuildObserver;
 
 class BlockMap
 {
 public:
     BlockMap(Map &map);
 
-    void build(Renderer &renderer);
+    void build(BuildObserver *observer = nullptr);
     void save();
 
+    // The number of distinct lists of lines, which blocks with the same lines share
+    std::size_t num_lists() const { return lists.size(); }
+
 private:
     using List   = std::vector<std::uint16_t>;
     using Blocks = std::vector<unsigned int>;
@@ -36,8 +39,13 @@ private:
     const unsigned int header_size = 4;
     const float block_size = 128;
 
-    // Generate a block
-    bool gen(unsigned int x, unsigned int y, Renderer &renderer);
+    // Without an observer, a NullObserver is used so that none of the progress reporting gets compiled in
+    template <typename Observer>
+    void generate(Observer &observer);
+
+    // Generate a block, counting it if it contains any lines
+    template <typename Observer>
+    void gen(unsigned int x, unsigned int y, Observer &observer, int &block_count);
 
     Map &map_;
     unsigned int width, height;
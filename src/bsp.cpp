@@ -14,83 +14,454 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "bsp.hpp"
-#include "node.hpp"
+#include <map>
+#include <tuple>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef NODEBUILDER_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+    const char *format_names[] = { "auto", "vanilla", "xnod", "znod" };
+
+    // Extended nodes are little endian whatever the machine is
+    void put16(std::vector<std::uint8_t> &out, std::uint16_t value) {
+        out.push_back(value & 0xff);
+        out.push_back(value >> 8);
+    }
 
-Bsp::Bsp(Map &map) : map_(map), root(nullptr) {
+    void put32(std::vector<std::uint8_t> &out, std::uint32_t value) {
+        put16(out, value & 0xffff);
+        put16(out, value >> 16);
+    }
 }
 
-Bsp::~Bsp() {
-    if (root)
-        delete root;
+Bsp::Bsp(Map &map) : map_(map), root(0), num_linedef_vertices(0) {
 }
 
-void Bsp::build(Renderer &renderer) {
-    auto segs = create_segs();
+void Bsp::build(ThreadPool *pool, BuildObserver *observer, const BuildOptions &options) {
+    // Nothing from an earlier build is used
+    seg_pool.clear();
+    node_pool.clear();
+    leaf_segs.clear();
 
+    auto segs = create_segs(options.collinear_groups);
+
+    // The area covered by the whole tree, which is only used to show the progress
     Polyf poly;
-    poly.add(Vec2f(map_.bounds().min().x, map_.bounds().min().y));
-    poly.add(Vec2f(map_.bounds().min().x, map_.bounds().max().y));
-    poly.add(Vec2f(map_.bounds().max().x, map_.bounds().max().y));
-    poly.add(Vec2f(map_.bounds().max().x, map_.bounds().min().y));
+    if (observer) {
+        poly.add(Vec2f(map_.bounds().min().x, map_.bounds().min().y));
+        poly.add(Vec2f(map_.bounds().min().x, map_.bounds().max().y));
+        poly.add(Vec2f(map_.bounds().max().x, map_.bounds().max().y));
+        poly.add(Vec2f(map_.bounds().max().x, map_.bounds().min().y));
+    }
 
-    int num_nodes = 0;
-    int num_segs = 0;
-    int num_ssectors = 0;
+    // Building cuts the segs in place, so keep them as they were
+    built_segs.clear();
+    for (auto index : segs)
+        built_segs.push_back(seg_pool[index]);
 
-    root = new Node(segs, poly, renderer, num_nodes, num_segs, num_ssectors);
+    built_options = options;
+
+    Node::Context context(seg_pool, node_pool, leaf_segs, pool, observer, options);
+    root = node_pool.allocate(1);
+    Node::create(root, std::move(segs), poly, context);
+
+    record_work(context);
 }
 
-void Bsp::save() {
-    // Dont save if no nodes have been built
-    if (!root)
+void Bsp::rebuild(ThreadPool *pool, const BuildOptions &options) {
+    // Every splitter would need choosing again
+    if (!node_pool.size() || options.exact != built_options.exact || options.heuristic != built_options.heuristic) {
+        build(pool, nullptr, options);
         return;
+    }
+
+    auto segs = create_segs(options.collinear_groups);
+
+    // Segs are the same if they have the same points, side, and linedef
+    using Key = std::tuple<float, float, float, float, bool, unsigned int>;
+    auto key = [](const Seg &seg) {
+        return Key(seg.p1().x, seg.p1().y, seg.p2().x, seg.p2().y, seg.side(), seg.linedef());
+    };
+
+    std::map<Key, std::size_t> previous;
+    for (std::size_t i = 0; i < built_segs.size(); i++)
+        previous.emplace(key(built_segs[i]), i);
+
+    std::vector<unsigned int> kept, added, removed;
+    std::vector<bool> matched(built_segs.size(), false);
+
+    for (auto index : segs) {
+        auto it = previous.find(key(seg_pool[index]));
+
+        if (it != previous.end() && !matched[it->second]) {
+            matched[it->second] = true;
+            kept.push_back(index);
+        }
+        else
+            added.push_back(index);
+    }
+
+    // The old segs have been cut up by the old tree, so the copies get added back to show where they were
+    for (std::size_t i = 0; i < built_segs.size(); i++) {
+        if (!matched[i])
+            removed.push_back(seg_pool.add(built_segs[i]));
+    }
+
+    built_segs.clear();
+    for (auto index : segs)
+        built_segs.push_back(seg_pool[index]);
+
+    built_options = options;
+
+    // The old nodes and segs stay in the pools until it's done, so the sub-trees that didn't change can be shared
+    Node::Context context(seg_pool, node_pool, leaf_segs, pool, nullptr, options);
+    root = Node::rebuild(root, std::move(kept), std::move(added), std::move(removed), context);
+
+    // Drop whatever the new tree no longer uses, so the pools don't keep growing with every rebuild
+    root = Node::compact(root, seg_pool, node_pool, leaf_segs);
+
+    record_work(context);
+}
+
+void Bsp::record_work(const Node::Context &context) {
+    work.candidates = context.num_candidates;
+    work.classified = context.num_classified;
+    work.cuts       = context.num_cuts;
+}
+
+Bsp::Stats Bsp::stats() const {
+    Stats stats = work;
+    stats.pooled_segs  = seg_pool.size();
+    stats.pooled_nodes = node_pool.size();
+
+    if (!node_pool.size())
+        return stats;
+
+    // Walk the tree from the root, as a rebuilt tree shares nodes with older ones
+    std::uint64_t total_depth = 0;
+    std::vector<std::pair<unsigned int, unsigned int>> stack = {{root, 0}};
+
+    while (!stack.empty()) {
+        auto [index, depth] = stack.back();
+        const auto &node = node_pool[index];
+        stack.pop_back();
+
+        if (node.leaf()) {
+            stats.leaves++;
+            stats.segs      += node.num_segs();
+            stats.max_depth  = std::max(stats.max_depth, depth);
+            total_depth     += depth;
+        }
+        else {
+            stats.nodes++;
+            stack.emplace_back(node.left (), depth + 1);
+            stack.emplace_back(node.right(), depth + 1);
+        }
+    }
+
+    stats.average_depth = static_cast<double>(total_depth) / stats.leaves;
+
+    return stats;
+}
+
+Bsp::Format Bsp::save(Format format) {
+    // Dont save if no nodes have been built
+    if (!node_pool.size())
+        return Format::Vanilla;
+
+    // Start over, in case the nodes have been rebuilt since they were last saved
+    vertices.clear();
+    vertex_table.clear();
+    linedefs.clear();
+    segs.clear();
+    ssectors.clear();
+    nodes.clear();
+
+    // Every linedef and seg can add at most two vertices, and the pools only hold the segs of the current tree
+    reserve_vertices(map_.num_vertices() + 2 * leaf_segs.size());
 
     // Recursively process the nodes
     process_linedefs();
-    process_node(root);
+    num_linedef_vertices = vertices.size();
+    process_node(node_pool[root]);
+
+    if (format == Format::Auto) {
+#ifdef NODEBUILDER_ZLIB
+        format = fits_vanilla() ? Format::Vanilla : Format::ZNod;
+#else
+        format = fits_vanilla() ? Format::Vanilla : Format::XNod;
+#endif
+    }
+
+    if (format == Format::Vanilla) {
+        if (!fits_vanilla())
+            throw std::runtime_error("Map " + map_.map() + " has too many segs, subsectors, nodes, or vertices for vanilla nodes");
+
+        save_vanilla();
+    }
+    else {
+#ifndef NODEBUILDER_ZLIB
+        if (format == Format::ZNod)
+            throw std::runtime_error("ZNOD nodes need a build with zlib");
+#endif
+
+        save_extended(format == Format::ZNod);
+    }
+
+    return format;
+}
+
+bool Bsp::parse_format(const std::string &name, Format &format) {
+    for (std::size_t i = 0; i < sizeof(format_names) / sizeof(format_names[0]); i++) {
+        if (name == format_names[i]) {
+            format = static_cast<Format>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::string Bsp::format_name(Format format) {
+    return format_names[static_cast<int>(format)];
+}
+
+Bsp::Format Bsp::saved_format(const Map &map) {
+    if (!map.extended_nodes())
+        return Format::Vanilla;
+
+    std::size_t size;
+    return map.get_lump("NODES", size)[0] == 'Z' ? Format::ZNod : Format::XNod;
+}
+
+bool Bsp::fits_vanilla() const {
+    // Subsectors and nodes share the child indices of nodes, with the top bit telling them apart
+    return vertices.size() <= 0xffff &&
+           segs.size()     <= 0xffff &&
+           ssectors.size() <= 0x7fff &&
+           nodes.size()    <= 0x7fff;
+}
+
+void Bsp::save_vanilla() {
+    std::vector<Map::Seg> map_segs;
+    std::vector<Map::SSector> map_ssectors;
+    std::vector<Map::Node> map_nodes;
+
+    map_segs.reserve(segs.size());
+    map_ssectors.reserve(ssectors.size());
+    map_nodes.reserve(nodes.size());
+
+    for (const auto &seg : segs)
+        map_segs.push_back({ static_cast<std::uint16_t>(seg.start), static_cast<std::uint16_t>(seg.end), seg.angle, seg.linedef, seg.dir, seg.offset });
+
+    for (const auto &ssector : ssectors)
+        map_ssectors.push_back({ static_cast<std::uint16_t>(ssector.count), static_cast<std::uint16_t>(ssector.first) });
+
+    for (const auto &node : nodes) {
+        Map::Node map_node;
+        map_node.x  = node.x;
+        map_node.y  = node.y;
+        map_node.dx = node.dx;
+        map_node.dy = node.dy;
+
+        std::copy_n(node.lbounds, 4, map_node.lbounds);
+        std::copy_n(node.rbounds, 4, map_node.rbounds);
+
+        for (int i = 0; i < 2; i++) {
+            if (node.child[i] & ssector_flag)
+                map_node.child[i] = (node.child[i] & ~ssector_flag) | (1 << 15); // Sub sector flag
+            else
+                map_node.child[i] = node.child[i];
+        }
+
+        map_nodes.push_back(map_node);
+    }
 
     // Replace the lumps
-    map_.replace_vertices(&vertices[0], vertices.size());
-    map_.replace_linedefs(&linedefs[0], linedefs.size());
-    map_.replace_segs(&segs[0], segs.size());
-    map_.replace_ssectors(&ssectors[0], ssectors.size());
-    map_.replace_nodes(&nodes[0], nodes.size());
+    map_.replace_vertices(vertices.data(), vertices.size());
+    map_.replace_linedefs(linedefs.data(), linedefs.size());
+    map_.replace_segs(map_segs.data(), map_segs.size());
+    map_.replace_ssectors(map_ssectors.data(), map_ssectors.size());
+    map_.replace_nodes(map_nodes.data(), map_nodes.size());
 }
 
-std::vector<Seg> Bsp::create_segs() {
-    std::vector<Seg> segs;
+void Bsp::save_extended(bool compress) {
+    std::vector<std::uint8_t> data;
+
+    // Only the vertices that segs add go in the nodes, the rest stay in VERTEXES
+    put32(data, num_linedef_vertices);
+    put32(data, vertices.size() - num_linedef_vertices);
+
+    for (auto i = num_linedef_vertices; i < vertices.size(); i++) {
+        put32(data, static_cast<std::uint32_t>(vertices[i].x) << 16); // Fixed point
+        put32(data, static_cast<std::uint32_t>(vertices[i].y) << 16);
+    }
+
+    // The segs of each subsector follow on from the last, so only the counts are needed
+    put32(data, ssectors.size());
+    for (const auto &ssector : ssectors)
+        put32(data, ssector.count);
+
+    put32(data, segs.size());
+    for (const auto &seg : segs) {
+        put32(data, seg.start);
+        put32(data, seg.end);
+        put16(data, seg.linedef);
+        data.push_back(seg.dir);
+    }
+
+    put32(data, nodes.size());
+    for (const auto &node : nodes) {
+        put16(data, node.x);
+        put16(data, node.y);
+        put16(data, node.dx);
+        put16(data, node.dy);
+
+        for (auto bound : node.lbounds)
+            put16(data, bound);
+        for (auto bound : node.rbounds)
+            put16(data, bound);
+
+        put32(data, node.child[0]);
+        put32(data, node.child[1]);
+    }
+
+    std::vector<std::uint8_t> lump = { 'X', 'N', 'O', 'D' };
+
+#ifndef NODEBUILDER_ZLIB
+    // save() already refuses ZNOD without zlib
+    static_cast<void>(compress);
+#endif
+
+#ifdef NODEBUILDER_ZLIB
+    // Everything after the magic is compressed
+    if (compress) {
+        uLongf size = compressBound(data.size());
+        lump.resize(4 + size);
+
+        if (compress2(&lump[4], &size, data.data(), data.size(), Z_BEST_COMPRESSION) != Z_OK)
+            throw std::runtime_error("Unable to compress the nodes of map " + map_.map());
+
+        lump.resize(4 + size);
+        lump[0] = 'Z';
+    }
+    else
+#endif
+        lump.insert(lump.end(), data.begin(), data.end());
+
+    // The segs and subsectors are part of the nodes, so their own lumps are left empty
+    map_.replace_vertices(vertices.data(), num_linedef_vertices);
+    map_.replace_linedefs(linedefs.data(), linedefs.size());
+    map_.replace_segs(nullptr, 0);
+    map_.replace_ssectors(nullptr, 0);
+    map_.replace_extended_nodes(lump.data(), lump.size());
+}
+
+std::vector<unsigned int> Bsp::create_segs(bool groups_enabled) {
+    std::vector<unsigned int> segs;
 
     auto vertices = map_.get_vertices();
     auto linedefs = map_.get_linedefs();
 
+    // Every distinct infinite line and direction, in the form "a*x + b*y = c"
+    std::map<std::tuple<std::int64_t, std::int64_t, std::int64_t>, unsigned int> groups;
+
+    auto find_group = [&](std::int64_t a, std::int64_t b, std::int64_t c) {
+        return groups.emplace(std::make_tuple(a, b, c), groups.size()).first->second;
+    };
+
     for (auto i = 0; i < map_.num_linedefs(); i++, linedefs++) {
         auto p1 = Vec2f(vertices[linedefs->start].x, vertices[linedefs->start].y);
         auto p2 = Vec2f(vertices[linedefs->end].x, vertices[linedefs->end].y);
 
-        segs.push_back(Seg(p1, p2, false, 0, i));
+        // Reduce the line to its simplest form, so that collinear linedefs going the same way share the same group
+        // Segs going the other way put the segs of the line on the other side, so they can't share it
+        std::int64_t a = vertices[linedefs->end].y - vertices[linedefs->start].y;
+        std::int64_t b = vertices[linedefs->start].x - vertices[linedefs->end].x;
+        std::int64_t d = std::gcd(a, b);
+
+        auto front_group = Seg::no_group;
+        auto back_group  = Seg::no_group;
+
+        if (d && groups_enabled) {
+            a /= d;
+            b /= d;
+
+            std::int64_t c = a * vertices[linedefs->start].x + b * vertices[linedefs->start].y;
+            front_group = find_group(a, b, c);
+
+            if (linedefs->flags & 0b100)
+                back_group = find_group(-a, -b, -c);
+        }
+
+        segs.push_back(seg_pool.add(Seg(p1, p2, false, 0, i, front_group)));
 
         // Two sided
         if (linedefs->flags & 0b100)
-            segs.push_back(Seg(p2, p1, true, 0, i));
+            segs.push_back(seg_pool.add(Seg(p2, p1, true, 0, i, back_group)));
     }
 
     return segs;
 }
 
 std::size_t Bsp::unique_vertex(int x, int y) {
-    // First check to see if the vertex already exists
-    for (auto i = 0; i < vertices.size(); i++) {
-        if (vertices[i].x == x && vertices[i].y == y)
-            return i;
-    }
-
-    // Otherwise create it
     Map::Vertex vertex;
     vertex.x = x;
     vertex.y = y;
-    vertices.push_back(vertex);
 
-    return vertices.size() - 1;
+    // Keep the table at most half full
+    if ((vertices.size() + 1) * 2 > vertex_table.size())
+        reserve_vertices(std::max<std::size_t>(vertices.size() + 1, vertex_table.size()));
+
+    // First check to see if the vertex already exists
+    std::size_t mask = vertex_table.size() - 1;
+
+    for (auto slot = vertex_slot(vertex) & mask;; slot = (slot + 1) & mask) {
+        if (!vertex_table[slot]) {
+            // Otherwise create it
+            vertices.push_back(vertex);
+            vertex_table[slot] = vertices.size();
+
+            return vertices.size() - 1;
+        }
+
+        const auto &existing = vertices[vertex_table[slot] - 1];
+        if (existing.x == vertex.x && existing.y == vertex.y)
+            return vertex_table[slot] - 1;
+    }
+}
+
+std::size_t Bsp::vertex_slot(const Map::Vertex &vertex) {
+    std::uint64_t key = (static_cast<std::uint64_t>(static_cast<std::uint16_t>(vertex.x)) << 16) | static_cast<std::uint16_t>(vertex.y);
+    return (key * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+void Bsp::reserve_vertices(std::size_t count) {
+    std::size_t size = 16;
+    while (size < count * 2)
+        size *= 2;
+
+    if (size <= vertex_table.size())
+        return;
+
+    vertices.reserve(count);
+
+    // Put the existing vertices back in the bigger table
+    vertex_table.assign(size, 0);
+    std::size_t mask = size - 1;
+
+    for (std::size_t i = 0; i < vertices.size(); i++) {
+        auto slot = vertex_slot(vertices[i]) & mask;
+        while (vertex_table[slot])
+            slot = (slot + 1) & mask;
+
+        vertex_table[slot] = i + 1;
+    }
 }
 
 // Not exactly nessary, but still might as well have this, as to insure unique vertices
@@ -107,14 +478,15 @@ void Bsp::process_linedefs() {
     }
 }
 
-int Bsp::process_ssector(const Node *node) {
-    Map::SSector ssector;
-    ssector.count = node->segs().size();
+std::uint32_t Bsp::process_ssector(const Node &node) {
+    SavedSSector ssector;
+    ssector.count = node.num_segs();
     ssector.first = segs.size();
 
     // Process the segs
-    for (const auto &seg : node->segs()) {
-        Map::Seg map_seg;
+    for (auto i = 0; i < node.num_segs(); i++) {
+        const auto &seg = seg_pool[leaf_segs[node.first_seg() + i]];
+        SavedSeg map_seg;
 
         map_seg.start   = unique_vertex(seg.p1().x, seg.p1().y);
         map_seg.end     = unique_vertex(seg.p2().x, seg.p2().y);
@@ -131,34 +503,69 @@ int Bsp::process_ssector(const Node *node) {
     return ssectors.size() - 1;
 }
 
-int Bsp::process_node(const Node *node) {
+std::uint32_t Bsp::process_node(const Node &node) {
     // If the node is a leaf, create sub sector
-    if (node->leaf())
-        return process_ssector(node) | (1 << 15); // Sub sector flag
-
-    Map::Node map_node;
-    map_node.x  = node->splitter().p.x;
-    map_node.y  = node->splitter().p.y;
-    map_node.dx = node->splitter().dx;
-    map_node.dy = node->splitter().dy;
-
-    // Process the children nodes
-    map_node.child[0] = process_node(node->left());
-    map_node.child[1] = process_node(node->right());
-
-    // Left bounding box
-    map_node.lbounds[0] = node->left()->bounds().max().y; // Top
-    map_node.lbounds[1] = node->left()->bounds().min().y; // Bottom
-    map_node.lbounds[2] = node->left()->bounds().min().x; // Left
-    map_node.lbounds[3] = node->left()->bounds().max().x; // Right
-
-    // Right bounding box
-    map_node.rbounds[0] = node->right()->bounds().max().y; // Top
-    map_node.rbounds[1] = node->right()->bounds().min().y; // Bottom
-    map_node.rbounds[2] = node->right()->bounds().min().x; // Left
-    map_node.rbounds[3] = node->right()->bounds().max().x; // Right
-
-    nodes.push_back(map_node);
-
-    return nodes.size() - 1;
+    if (node.leaf())
+        return process_ssector(node) | ssector_flag;
+
+    // Walk the tree without recursing, so a deep tree can't overflow the stack
+    // Each node is saved once both of its children have been, left first, the same order as a recursive walk
+    struct Visit {
+        const Node *node;
+        SavedNode map_node;
+        int child; // The next child to process
+    };
+
+    auto visit = [&](const Node &node) {
+        const auto &left  = node_pool[node.left()];
+        const auto &right = node_pool[node.right()];
+
+        SavedNode map_node;
+        map_node.x  = node.splitter().p.x;
+        map_node.y  = node.splitter().p.y;
+        map_node.dx = node.splitter().dx;
+        map_node.dy = node.splitter().dy;
+
+        // Left bounding box
+        map_node.lbounds[0] = left.bounds().max().y; // Top
+        map_node.lbounds[1] = left.bounds().min().y; // Bottom
+        map_node.lbounds[2] = left.bounds().min().x; // Left
+        map_node.lbounds[3] = left.bounds().max().x; // Right
+
+        // Right bounding box
+        map_node.rbounds[0] = right.bounds().max().y; // Top
+        map_node.rbounds[1] = right.bounds().min().y; // Bottom
+        map_node.rbounds[2] = right.bounds().min().x; // Left
+        map_node.rbounds[3] = right.bounds().max().x; // Right
+
+        return Visit{&node, map_node, 0};
+    };
+
+    std::vector<Visit> stack = { visit(node) };
+
+    while (true) {
+        auto &top = stack.back();
+
+        // Process the children nodes
+        if (top.child < 2) {
+            const auto &child = node_pool[top.child ? top.node->right() : top.node->left()];
+
+            if (child.leaf())
+                top.map_node.child[top.child++] = process_ssector(child) | ssector_flag;
+            else
+                stack.push_back(visit(child));
+
+            continue;
+        }
+
+        nodes.push_back(top.map_node);
+        stack.pop_back();
+
+        std::uint32_t index = nodes.size() - 1;
+        if (stack.empty())
+            return index;
+
+        auto &parent = stack.back();
+        parent.map_node.child[parent.child++] = index;
+    }
 }
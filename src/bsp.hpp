@@ -17,34 +17,137 @@
 
 #include "map.hpp"
 #include "seg.hpp"
+#include "seg_pool.hpp"
+#include "node.hpp"
 #include <vector>
+#include <string>
+#include <cstdint>
 
-class Node;
-class Renderer;
+class ThreadPool;
+class BuildObserver;
 
 class Bsp
 {
 public:
+    // Describes the tree and how much work went into the last build or rebuild
+    struct Stats {
+        std::size_t nodes  = 0; // Not counting leaves
+        std::size_t leaves = 0;
+        std::size_t segs   = 0;
+        unsigned int max_depth = 0;
+        double average_depth   = 0; // Of the leaves
+
+        std::uint64_t candidates = 0; // Splitters that were scored
+        std::uint64_t classified = 0; // Points that were classified against a splitter, which depends on scheduling with a thread pool
+        std::uint64_t cuts       = 0; // Segs that were cut in two
+
+        // What's held in the pools, which is only ever more than the tree while it's being built
+        std::size_t pooled_segs  = 0;
+        std::size_t pooled_nodes = 0; // Including leaves
+    };
+
+    // The formats that the nodes can be saved in
+    enum class Format {
+        Auto,    // Vanilla if the map fits in it, otherwise ZNOD, or XNOD when built without zlib
+        Vanilla, // The original SEGS, SSECTORS, and NODES lumps, with 16-bit indices
+        XNod,    // ZDoom's extended nodes, with 32-bit indices, all in the NODES lump
+        ZNod     // The same as XNOD, compressed with zlib
+    };
+
     Bsp(Map &map);
-    ~Bsp();
 
-    void build(Renderer &renderer);
-    void save();
+    /**
+     * Builds the nodes of the map
+     * @param pool Optional, for building in parallel
+     * @param observer Optional, for following the progress of the build
+     * @param options How segs are classified and splitters are chosen
+     */
+    void build(ThreadPool *pool = nullptr, BuildObserver *observer = nullptr, const BuildOptions &options = {});
+
+    /**
+     * Builds the nodes again after the map has been edited, only rebuilding the parts of the tree that the changes reach
+     * Falls back on a full build if nothing has been built yet, or the options choose splitters differently
+     * @param pool Optional, for building in parallel
+     * @param options How segs are classified and splitters are chosen
+     */
+    void rebuild(ThreadPool *pool = nullptr, const BuildOptions &options = {});
+
+    /**
+     * Saves the nodes to the map, throwing if they don't fit in the format or it isn't supported
+     * @param format The format to save them in
+     * @return The format that was used, which is never Auto
+     */
+    Format save(Format format = Format::Auto);
+
+    static bool parse_format(const std::string &name, Format &format);
+    static std::string format_name(Format format);
+
+    // Finds the format of the nodes a map has, such as from an earlier save or the build cache
+    static Format saved_format(const Map &map);
+
+    Stats stats() const;
 
 private:
-    std::vector<Seg> create_segs();
+    // Gives collinear segs going the same way the same group, unless it's turned off
+    std::vector<unsigned int> create_segs(bool groups_enabled);
+    void record_work(const Node::Context &context);
     std::size_t unique_vertex(int x, int y);
 
+    // Makes room for a number of unique vertices, so that adding them never has to grow the table
+    void reserve_vertices(std::size_t count);
+    static std::size_t vertex_slot(const Map::Vertex &vertex);
+
+    // The tree as it's saved, with 32-bit indices that are narrowed for the vanilla format
+    struct SavedSeg {
+        std::uint32_t start;
+        std::uint32_t end;
+        std::uint16_t angle;
+        std::uint16_t linedef;
+        std::uint16_t dir;
+        std::uint16_t offset;
+    };
+
+    struct SavedSSector {
+        std::uint32_t count;
+        std::uint32_t first;
+    };
+
+    struct SavedNode {
+        std::int16_t x;
+        std::int16_t y;
+        std::int16_t dx;
+        std::int16_t dy;
+        std::int16_t lbounds[4];
+        std::int16_t rbounds[4];
+        std::uint32_t child[2];
+    };
+
+    static constexpr std::uint32_t ssector_flag = 0x80000000;
+
     void process_linedefs();
-    int process_ssector(const Node *node);
-    int process_node(const Node *node);
+    std::uint32_t process_ssector(const Node &node);
+    std::uint32_t process_node(const Node &node);
+
+    bool fits_vanilla() const;
+    void save_vanilla();
+    void save_extended(bool compress);
 
     Map &map_;
-    Node *root;
+    SegPool seg_pool;      // Every seg made while building the nodes
+    NodePool node_pool;    // Every node in the tree
+    LeafSegPool leaf_segs; // The segs of each leaf node
+    unsigned int root;
+
+    Stats work; // Only the counts of work done, as the rest is found from the tree
+
+    std::vector<Seg> built_segs; // Copies of the segs that the tree was built from, to find what's changed when rebuilding
+    BuildOptions built_options;
 
     std::vector<Map::Vertex> vertices;
+    std::vector<std::uint32_t> vertex_table; // Open addressing table of the index plus one of each vertex, or zero if empty
+    std::size_t num_linedef_vertices;        // The vertices that linedefs use, which come before the ones only segs use
     std::vector<Map::LineDef> linedefs;
-    std::vector<Map::Seg> segs;
-    std::vector<Map::SSector> ssectors;
-    std::vector<Map::Node> nodes;
+    std::vector<SavedSeg> segs;
+    std::vector<SavedSSector> ssectors;
+    std::vector<SavedNode> nodes;
 };
@@ -0,0 +1,190 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "build_cache.hpp"
+#include "map.hpp"
+#include "hash.hpp"
+#include "common.hpp"
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <random>
+#include <vector>
+#include <cstring>
+
+namespace {
+    // Identifies a cache file, and changes whenever the layout does
+    const char magic[8] = {'N', 'B', 'C', 'A', 'C', 'H', 'E', '1'};
+
+    // Everything the nodes and blockmap are built from
+    const char *input_lumps[] = {"THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SECTORS"};
+
+    // Everything that building the nodes and blockmap replaces
+    const char *output_lumps[] = {"VERTEXES", "LINEDEFS", "SEGS", "SSECTORS", "NODES", "BLOCKMAP"};
+
+    struct Entry {
+        char name[8];
+        std::uint32_t size;
+    };
+}
+
+BuildCache::BuildCache(const std::string &path, const std::string &salt) : path_(path), salt_(salt), hits_(0), misses_(0) {
+    std::error_code error;
+    std::filesystem::create_directories(path_, error);
+
+    if (error)
+        throw std::runtime_error("Unable to create cache directory " + path + ": " + error.message());
+}
+
+std::uint64_t BuildCache::key(const Map &map, const BuildOptions &options) const {
+    Hash64 hash;
+    hash.update(salt_);
+
+    // Lumps are hashed as they're stored in memory, so machines with a different byte order never share entries
+    std::uint8_t byte_order = BYTE_ORDER == BIG_ENDIAN;
+    hash.update(&byte_order, sizeof(byte_order));
+
+    std::int64_t settings[] = {
+        options.exact, static_cast<std::int64_t>(options.heuristic), options.quality_budget.count(), options.beam_width, options.beam_depth
+    };
+    hash.update(settings, sizeof(settings));
+
+    for (auto name : input_lumps) {
+        std::size_t size;
+        auto data = map.get_lump(name, size);
+
+        hash.update(name);
+        hash.update(&size, sizeof(size));
+        hash.update(data, size);
+    }
+
+    return hash.digest();
+}
+
+bool BuildCache::load(std::uint64_t key, Map &map) {
+    std::ifstream file(file_path(key), std::ios::in | std::ios::binary);
+    std::vector<char> contents;
+
+    if (file.good())
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    // The file ends with a hash of everything before it, so anything cut short or damaged is a miss
+    bool valid = contents.size() >= sizeof(magic) + sizeof(std::uint64_t) && !std::memcmp(contents.data(), magic, sizeof(magic));
+
+    if (valid) {
+        std::uint64_t stored;
+        std::memcpy(&stored, contents.data() + contents.size() - sizeof(stored), sizeof(stored));
+
+        Hash64 hash;
+        hash.update(contents.data(), contents.size() - sizeof(stored));
+        valid = hash.digest() == stored;
+    }
+
+    // Read every lump before replacing any, so the map is never left half replaced
+    std::vector<std::pair<std::string, std::pair<std::size_t, std::size_t>>> lumps;
+    std::size_t pos = sizeof(magic);
+    std::size_t end = contents.size() - sizeof(std::uint64_t);
+
+    while (valid && pos < end) {
+        Entry entry;
+
+        if (end - pos < sizeof(entry)) {
+            valid = false;
+            break;
+        }
+
+        std::memcpy(&entry, contents.data() + pos, sizeof(entry));
+        pos += sizeof(entry);
+
+        if (end - pos < entry.size) {
+            valid = false;
+            break;
+        }
+
+        lumps.emplace_back(std::string(entry.name, strnlen(entry.name, sizeof(entry.name))), std::make_pair(pos, entry.size));
+        pos += entry.size;
+    }
+
+    // Check that every lump fits before replacing the first, as an entry from a different map layout could be refused part way
+    for (const auto &[name, range] : lumps)
+        valid = valid && map.can_replace_lump(name, contents.data() + range.first, range.second);
+
+    if (valid) {
+        for (const auto &[name, range] : lumps)
+            map.replace_lump(name, contents.data() + range.first, range.second);
+    }
+
+    if (!valid) {
+        misses_++;
+        return false;
+    }
+
+    hits_++;
+    return true;
+}
+
+void BuildCache::store(std::uint64_t key, const Map &map) const {
+    std::vector<char> contents(magic, magic + sizeof(magic));
+
+    for (auto name : output_lumps) {
+        std::size_t size;
+        auto data = map.get_lump(name, size);
+
+        if (!data)
+            continue;
+
+        Entry entry = {};
+        std::strncpy(entry.name, name, sizeof(entry.name));
+        entry.size = size;
+
+        auto header = reinterpret_cast<const char*>(&entry);
+        contents.insert(contents.end(), header, header + sizeof(entry));
+        contents.insert(contents.end(), data, data + size);
+    }
+
+    Hash64 hash;
+    hash.update(contents.data(), contents.size());
+
+    auto digest = hash.digest();
+    auto bytes  = reinterpret_cast<const char*>(&digest);
+    contents.insert(contents.end(), bytes, bytes + sizeof(digest));
+
+    // Write to a temporary file first, so other builds sharing the cache never see it half written
+    auto path = file_path(key);
+    auto temp_path = path;
+    temp_path += "." + std::to_string(std::random_device()()) + ".tmp";
+
+    std::ofstream temp(temp_path, std::ios::out | std::ios::binary);
+    temp.write(contents.data(), contents.size());
+    temp.close();
+
+    std::error_code error;
+
+    if (temp.good())
+        std::filesystem::rename(temp_path, path, error);
+
+    if (!temp.good() || error) {
+        std::cerr << "Warning: Unable to write to the build cache at " << path_.string() << std::endl;
+        std::filesystem::remove(temp_path, error);
+    }
+}
+
+std::filesystem::path BuildCache::file_path(std::uint64_t key) const {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << ".lumps";
+
+    return path_ / name.str();
+}
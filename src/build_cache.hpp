@@ -0,0 +1,68 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "node.hpp"
+#include <string>
+#include <cstdint>
+#include <filesystem>
+
+class Map;
+
+// The lumps generated for maps by earlier runs, kept on disk by a hash of everything they were built from
+class BuildCache
+{
+public:
+    /**
+     * Opens a cache, creating its directory if needed
+     * @param path The directory to keep the cache in
+     * @param salt Anything else that changes the output, such as the version of the builder
+     */
+    BuildCache(const std::string &path, const std::string &salt);
+
+    /**
+     * Hashes the lumps that the nodes and blockmap are built from, along with the build options
+     * @param map The map to hash
+     * @param options The options it's being built with
+     * @return The key of the map in the cache
+     */
+    std::uint64_t key(const Map &map, const BuildOptions &options) const;
+
+    /**
+     * Replaces the generated lumps of a map with the ones stored for it, counting a hit if there were any
+     * @param key The key of the map
+     * @param map The map to replace the lumps of
+     * @return true if the lumps were found
+     */
+    bool load(std::uint64_t key, Map &map);
+
+    /**
+     * Stores the generated lumps of a map, which isn't an error if it fails
+     * @param key The key of the map
+     * @param map The map that's been built
+     */
+    void store(std::uint64_t key, const Map &map) const;
+
+    int hits  () const { return hits_; }
+    int misses() const { return misses_; }
+
+private:
+    std::filesystem::path file_path(std::uint64_t key) const;
+
+    std::filesystem::path path_;
+    std::string salt_;
+    int hits_, misses_;
+};
@@ -0,0 +1,81 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "line.hpp"
+#include "box.hpp"
+#include "polygon.hpp"
+#include "splitter.hpp"
+#include <vector>
+
+// Gets told about the progress of building a map, such as for drawing it
+// The builders are templated on the observer, and only do the extra work of reporting progress when it's active
+class BuildObserver
+{
+public:
+    static constexpr bool active = true;
+
+    virtual ~BuildObserver() = default;
+
+    /**
+     * Checks if the build should keep going
+     * @return False to stop building
+     */
+    virtual bool running() { return true; }
+
+    /**
+     * Called when a node starts being built
+     * @param segs The segs in the node
+     * @param poly The area covered by the node
+     */
+    virtual void node_started(const std::vector<Linef>&, const Polyf&) {}
+
+    /**
+     * Called when a node has been split
+     * @param splitter The splitter that was chosen
+     * @param nodes The number of nodes built so far
+     * @param segs The number of segs in finished sub-sectors so far
+     * @param ssectors The number of sub-sectors so far
+     */
+    virtual void node_split(const Splitter&, int, int, int) {}
+
+    /**
+     * Called when a node becomes a sub-sector
+     * @param poly The convex area of the sub-sector
+     */
+    virtual void leaf_created(const Polyf&) {}
+
+    /**
+     * Called when a block of the blockmap containing some lines has been generated
+     * @param box The area of the block
+     * @param lines The parts of each line inside of the block
+     * @param count The number of blocks reported before this one
+     */
+    virtual void block_created(const Boxf&, const std::vector<Linef>&, int) {}
+};
+
+// Used for headless builds, so all the progress reporting compiles away to nothing
+struct NullObserver
+{
+    static constexpr bool active = false;
+
+    bool running() { return true; }
+
+    void node_started(const std::vector<Linef>&, const Polyf&) {}
+    void node_split(const Splitter&, int, int, int) {}
+    void leaf_created(const Polyf&) {}
+    void block_created(const Boxf&, const std::vector<Linef>&, int) {}
+};
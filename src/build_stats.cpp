@@ -0,0 +1,73 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "build_stats.hpp"
+
+namespace {
+    std::string quote(const std::string &text) {
+        std::string quoted = "\"";
+
+        for (auto c : text) {
+            if (c == '"' || c == '\\')
+                quoted += '\\';
+
+            quoted += c;
+        }
+
+        return quoted + "\"";
+    }
+}
+
+void write_stats_json(std::ostream &out, const std::string &version, const std::vector<MapStats> &maps, double wad_write_ms) {
+    out << "{\n";
+    out << "  \"version\": " << quote(version) << ",\n";
+    out << "  \"wad_write_ms\": " << wad_write_ms << ",\n";
+
+    // Splitters scored in parallel stop early against a bound that the other threads lower, so this count can change between runs
+    out << "  \"scheduling_dependent\": [\"points_classified\"],\n";
+    out << "  \"maps\": [";
+
+    for (std::size_t i = 0; i < maps.size(); i++) {
+        const auto &map = maps[i];
+
+        out << (i ? ",\n" : "\n");
+        out << "    {\n";
+        out << "      \"name\": " << quote(map.name) << ",\n";
+        out << "      \"cached\": " << (map.cached ? "true" : "false") << ",\n";
+        out << "      \"nodes_format\": " << quote(Bsp::format_name(map.nodes_format)) << ",\n";
+        out << "      \"time_ms\": {\n";
+        out << "        \"load\": "           << map.load_ms           << ",\n";
+        out << "        \"validate\": "       << map.validate_ms       << ",\n";
+        out << "        \"bsp_build\": "      << map.bsp_build_ms      << ",\n";
+        out << "        \"bsp_save\": "       << map.bsp_save_ms       << ",\n";
+        out << "        \"blockmap_build\": " << map.blockmap_build_ms << ",\n";
+        out << "        \"blockmap_save\": "  << map.blockmap_save_ms  << "\n";
+        out << "      },\n";
+        out << "      \"splitter_candidates\": " << map.bsp.candidates    << ",\n";
+        out << "      \"points_classified\": "   << map.bsp.classified    << ",\n";
+        out << "      \"segs_cut\": "            << map.bsp.cuts          << ",\n";
+        out << "      \"nodes\": "               << map.bsp.nodes         << ",\n";
+        out << "      \"leaves\": "              << map.bsp.leaves        << ",\n";
+        out << "      \"segs\": "                << map.bsp.segs          << ",\n";
+        out << "      \"max_depth\": "           << map.bsp.max_depth     << ",\n";
+        out << "      \"average_depth\": "       << map.bsp.average_depth << ",\n";
+        out << "      \"blockmap_lists\": "      << map.blockmap_lists    << ",\n";
+        out << "      \"blockmap_words\": "      << map.blockmap_words    << "\n";
+        out << "    }";
+    }
+
+    out << (maps.empty() ? "]\n" : "\n  ]\n");
+    out << "}\n";
+}
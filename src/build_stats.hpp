@@ -0,0 +1,49 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "bsp.hpp"
+#include <string>
+#include <vector>
+#include <ostream>
+
+// What went into building one map, for --stats
+struct MapStats {
+    std::string name;
+    bool cached = false; // Copied from the build cache, so nothing was built
+
+    // The wall time of each phase in milliseconds
+    double load_ms           = 0;
+    double validate_ms       = 0;
+    double bsp_build_ms      = 0;
+    double bsp_save_ms       = 0;
+    double blockmap_build_ms = 0;
+    double blockmap_save_ms  = 0;
+
+    Bsp::Stats bsp;
+    Bsp::Format nodes_format = Bsp::Format::Vanilla;
+    std::size_t blockmap_lists = 0;
+    std::size_t blockmap_words = 0;
+};
+
+/**
+ * Writes a report of every map that was built as JSON
+ * @param out Where to write the report
+ * @param version The version of the builder
+ * @param maps The stats of each map
+ * @param wad_write_ms How long writing the WAD took in milliseconds
+ */
+void write_stats_json(std::ostream &out, const std::string &version, const std::vector<MapStats> &maps, double wad_write_ms);
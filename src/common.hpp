@@ -25,6 +25,10 @@
 #include <endian.h>
 #endif
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace Common {
 
 inline std::uint16_t swap16(std::uint16_t num) {
@@ -54,6 +58,24 @@ inline std::uint32_t little32(std::uint32_t num) {
 #endif
 }
 
+/**
+ * Counts the number of bits that are set
+ * @param num The number to check
+ * @return The number of set bits
+ */
+inline int popcount(std::uint64_t num) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<int>(__popcnt64(num));
+#elif defined(__GNUC__)
+    return __builtin_popcountll(num);
+#else
+    int count = 0;
+    for (; num; num &= num - 1)
+        count++;
+    return count;
+#endif
+}
+
 /**
  * Finds the sign of a number
  * @param value The number to check
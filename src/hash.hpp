@@ -0,0 +1,152 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+// Streaming 64-bit xxHash (XXH64), for telling if data has changed without comparing all of it
+class Hash64
+{
+public:
+    explicit Hash64(std::uint64_t seed = 0) : seed_(seed), length_(0), buffered_(0) {
+        acc_[0] = seed + prime1 + prime2;
+        acc_[1] = seed + prime2;
+        acc_[2] = seed;
+        acc_[3] = seed - prime1;
+    }
+
+    /**
+     * Adds data to the hash
+     * @param data The data to add
+     * @param size The size of the data in bytes
+     */
+    void update(const void *data, std::size_t size) {
+        auto bytes = static_cast<const std::uint8_t*>(data);
+        length_ += size;
+
+        // Finish off any stripe that was started by the last update
+        if (buffered_) {
+            auto count = std::min(size, sizeof(buffer_) - buffered_);
+            std::memcpy(buffer_ + buffered_, bytes, count);
+
+            buffered_ += count;
+            bytes     += count;
+            size      -= count;
+
+            if (buffered_ < sizeof(buffer_))
+                return;
+
+            stripe(buffer_);
+            buffered_ = 0;
+        }
+
+        for (; size >= sizeof(buffer_); bytes += sizeof(buffer_), size -= sizeof(buffer_))
+            stripe(bytes);
+
+        std::memcpy(buffer_, bytes, size);
+        buffered_ = size;
+    }
+
+    // Adds a string, including its length so that consecutive strings can't run together
+    void update(const std::string &text) {
+        std::uint64_t size = text.size();
+        update(&size, sizeof(size));
+        update(text.data(), text.size());
+    }
+
+    /**
+     * Finishes the hash of everything added so far, which can still be added to afterwards
+     * @return The hash
+     */
+    std::uint64_t digest() const {
+        std::uint64_t hash;
+
+        if (length_ >= sizeof(buffer_)) {
+            hash = rotate(acc_[0], 1) + rotate(acc_[1], 7) + rotate(acc_[2], 12) + rotate(acc_[3], 18);
+
+            for (auto acc : acc_)
+                hash = (hash ^ round(0, acc)) * prime1 + prime4;
+        }
+        else
+            hash = seed_ + prime5;
+
+        hash += length_;
+
+        // Mix in the bytes that didn't fill a whole stripe
+        std::size_t i = 0;
+
+        for (; i + 8 <= buffered_; i += 8)
+            hash = rotate(hash ^ round(0, read64(buffer_ + i)), 27) * prime1 + prime4;
+
+        if (i + 4 <= buffered_) {
+            hash = rotate(hash ^ (read32(buffer_ + i) * prime1), 23) * prime2 + prime3;
+            i += 4;
+        }
+
+        for (; i < buffered_; i++)
+            hash = rotate(hash ^ (buffer_[i] * prime5), 11) * prime1;
+
+        // Avalanche
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        hash *= prime3;
+        hash ^= hash >> 32;
+
+        return hash;
+    }
+
+private:
+    static constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    static constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr std::uint64_t prime3 = 0x165667B19E3779F9ull;
+    static constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+    static std::uint64_t rotate(std::uint64_t x, int bits) {
+        return (x << bits) | (x >> (64 - bits));
+    }
+
+    static std::uint64_t round(std::uint64_t acc, std::uint64_t input) {
+        return rotate(acc + input * prime2, 31) * prime1;
+    }
+
+    // Input is always read as little endian, so the hash is the same on every machine
+    static std::uint64_t read64(const std::uint8_t *p) {
+        return read32(p) | (read32(p + 4) << 32);
+    }
+
+    static std::uint64_t read32(const std::uint8_t *p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint64_t>(p[3]) << 24);
+    }
+
+    void stripe(const std::uint8_t *p) {
+        for (auto i = 0; i < 4; i++)
+            acc_[i] = round(acc_[i], read64(p + i * 8));
+    }
+
+    std::uint64_t seed_;
+    std::uint64_t acc_[4];
+    std::uint64_t length_;
+
+    // The start of a stripe that hasn't been filled yet
+    std::uint8_t buffer_[32];
+    std::size_t buffered_;
+};
@@ -15,17 +15,61 @@
 
 #include <iostream>
 #include <chrono>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <vector>
 
 #include "wad.hpp"
 #include "map.hpp"
-#include "renderer.hpp"
 #include "bsp.hpp"
 #include "blockmap.hpp"
+#include "thread_pool.hpp"
+#include "build_cache.hpp"
+#include "build_stats.hpp"
+
+#ifndef NODEBUILDER_HEADLESS
+#include "renderer.hpp"
+#include "render_observer.hpp"
+#endif
 
 #define VERSION "0.99"
 
 const char *banner = "NodeBuilder - Version " VERSION " (C) 2022 Zach Collins\n";
 
+// Reads a time like "5s", "500ms", or "2m", with plain numbers being seconds
+static bool parse_duration(const std::string &text, std::chrono::milliseconds &duration) {
+    std::size_t end;
+    double value;
+
+    try {
+        value = std::stod(text, &end);
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+
+    auto unit = text.substr(end);
+    double scale;
+
+    if (unit == "ms")
+        scale = 1;
+    else if (unit == "s" || unit.empty())
+        scale = 1000;
+    else if (unit == "m")
+        scale = 60000;
+    else
+        return false;
+
+    if (value < 0)
+        return false;
+
+    duration = std::chrono::milliseconds(static_cast<long long>(value * scale));
+    return true;
+}
+
 int main(int argc, char **argv) {
     if (argc < 2) {
         std::cerr << "Usage: " << argv[0] << " [WAD PATH] [MAPS...] [OPTIONS...]" << std::endl;
@@ -36,16 +80,92 @@ int main(int argc, char **argv) {
 
     std::vector<std::string> maps;
     bool draw = false;
+    BuildOptions options;
+    int threads = 1;
+    std::string cache_path;
+    std::string stats_path;
+    auto nodes_format = Bsp::Format::Auto;
 
     for (int i = 2; i < argc; i++) {
         auto arg = std::string(argv[i]);
 
-        if (arg == "--draw")
+        if (arg == "--draw") {
+#ifdef NODEBUILDER_HEADLESS
+            std::cerr << "Warning: --draw isn't supported by headless builds" << std::endl;
+#else
             draw = true;
+#endif
+        }
+        else if (arg == "--float")
+            options.exact = false;
+        else if (arg == "--heuristic") {
+            std::string name = i + 1 < argc ? argv[++i] : "";
+
+            if (name == "balance")
+                options.heuristic = Heuristic::Balance;
+            else if (name == "cost")
+                options.heuristic = Heuristic::Cost;
+            else {
+                std::cerr << "Expected balance or cost after --heuristic" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--quality-budget") {
+            if (i + 1 >= argc || !parse_duration(argv[++i], options.quality_budget)) {
+                std::cerr << "Expected a time such as 5s or 500ms after --quality-budget" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--nodes") {
+            if (i + 1 >= argc || !Bsp::parse_format(argv[++i], nodes_format)) {
+                std::cerr << "Expected auto, vanilla, xnod, or znod after --nodes" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--cache") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing directory after --cache" << std::endl;
+                return 1;
+            }
+
+            cache_path = argv[++i];
+        }
+        else if (arg == "--stats") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing file after --stats" << std::endl;
+                return 1;
+            }
+
+            stats_path = argv[++i];
+        }
+        else if (arg == "-j") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing thread count after -j" << std::endl;
+                return 1;
+            }
+
+            threads = std::atoi(argv[++i]);
+        }
         else
             maps.push_back(argv[i]);
     }
 
+    // Use every core if no count was given
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // The renderer can only be used from a single thread
+    if (draw && threads > 1) {
+        std::cerr << "Warning: --draw only supports a single thread" << std::endl;
+        threads = 1;
+    }
+
+    // Looking ahead stops at a deadline, so the lumps depend on how fast the machine is and shouldn't be reused
+    if (options.quality_budget.count() > 0 && !cache_path.empty()) {
+        std::cerr << "Warning: --cache isn't used with --quality-budget" << std::endl;
+        cache_path.clear();
+    }
+
     try {
         Wad wad(argv[1]);
 
@@ -62,12 +182,31 @@ int main(int argc, char **argv) {
 
         std::cout << "Processing " << maps.size() << " maps..." << std::endl;
 
+        std::unique_ptr<ThreadPool> pool;
+        if (threads > 1)
+            pool = std::make_unique<ThreadPool>(threads);
+
+        // Maps that haven't changed since they were last built can be copied from the cache
+        std::unique_ptr<BuildCache> cache;
+        if (!cache_path.empty())
+            cache = std::make_unique<BuildCache>(cache_path, banner + Bsp::format_name(nodes_format));
+
         std::chrono::milliseconds total_time(0);
+        std::vector<MapStats> map_stats;
+
+        // Milliseconds since a phase started, for the stats
+        auto elapsed = [](std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
 
         for (const auto &name : maps) {
             std::cout << "Processing " << name << "...\t" << std::flush;
 
+            MapStats stats;
+            stats.name = name;
+
             auto map_time_start = std::chrono::high_resolution_clock::now();
+            auto phase_start    = std::chrono::steady_clock::now();
             Map map(name, wad);
 
             if (!map.load()) {
@@ -75,45 +214,91 @@ int main(int argc, char **argv) {
                 return 1;
             }
 
+            stats.load_ms = elapsed(phase_start);
+            phase_start   = std::chrono::steady_clock::now();
+
             if (!map.valid()) {
                 std::cerr << "\nMap " << name << " contains errors!" << std::endl;
                 return 1;
             }
 
-            std::string title;
-            if (draw)
-                title = "DOOM NodeBuilder - " + name;
+            stats.validate_ms = elapsed(phase_start);
 
-            Renderer renderer(title, 1280, 720, map);
-            renderer.clear();
-            renderer.draw_map();
-            renderer.show();
+            // Only open a window when drawing, otherwise the build runs headless
+            std::unique_ptr<BuildObserver> observer;
 
-            // Generate the BSP
-            Bsp bsp(map);
-            bsp.build(renderer);
+#ifndef NODEBUILDER_HEADLESS
+            std::unique_ptr<Renderer> renderer;
 
-            if (!renderer.running()) {
-                std::cout << "\nTerminated" << std::endl;
-                return 1;
-            }
+            if (draw) {
+                renderer = std::make_unique<Renderer>("DOOM NodeBuilder - " + name, 1280, 720, map);
+                observer = std::make_unique<RenderObserver>(*renderer, map);
 
-            bsp.save();
+                renderer->clear();
+                renderer->draw_map();
+                renderer->show();
+            }
+#endif
 
-            // Generate the Blockmap
-            BlockMap blockmap(map);
-            blockmap.build(renderer);
+            std::uint64_t cache_key = 0;
+            bool cached = false;
 
-            if (!renderer.running()) {
-                std::cout << "\nTerminated" << std::endl;
-                return 1;
+            if (cache) {
+                cache_key = cache->key(map, options);
+                cached    = cache->load(cache_key, map);
             }
 
-            blockmap.save();
+            if (!cached) {
+                // Generate the BSP
+                phase_start = std::chrono::steady_clock::now();
+
+                Bsp bsp(map);
+                bsp.build(pool.get(), observer.get(), options);
+
+                if (observer && !observer->running()) {
+                    std::cout << "\nTerminated" << std::endl;
+                    return 1;
+                }
+
+                stats.bsp_build_ms = elapsed(phase_start);
+                phase_start        = std::chrono::steady_clock::now();
+
+                bsp.save(nodes_format);
+
+                stats.bsp_save_ms = elapsed(phase_start);
+                stats.bsp         = bsp.stats();
+
+                // Generate the Blockmap
+                phase_start = std::chrono::steady_clock::now();
+
+                BlockMap blockmap(map);
+                blockmap.build(observer.get());
+
+                if (observer && !observer->running()) {
+                    std::cout << "\nTerminated" << std::endl;
+                    return 1;
+                }
+
+                stats.blockmap_build_ms = elapsed(phase_start);
+                phase_start             = std::chrono::steady_clock::now();
+
+                blockmap.save();
+
+                stats.blockmap_save_ms = elapsed(phase_start);
+                stats.blockmap_lists   = blockmap.num_lists();
+                stats.blockmap_words   = map.num_blockmap();
+
+                if (cache)
+                    cache->store(cache_key, map);
+            }
 
             // Save all the map related lumps to the WAD
             map.save();
 
+            stats.cached       = cached;
+            stats.nodes_format = Bsp::saved_format(map);
+            map_stats.push_back(stats);
+
             auto map_time_end = std::chrono::high_resolution_clock::now();
             total_time += std::chrono::duration_cast<std::chrono::milliseconds>(map_time_end - map_time_start);
 
@@ -123,25 +308,48 @@ int main(int argc, char **argv) {
             }
             else {
                 auto dur = std::chrono::duration_cast<std::chrono::milliseconds>(map_time_end - map_time_start);
-                std::cout << dur.count() << "\tmsec" << std::endl;
+                std::cout << dur.count() << "\tmsec";
+
+                // Point out when the map was too big for vanilla nodes
+                if (stats.nodes_format != Bsp::Format::Vanilla)
+                    std::cout << "\t(" << Bsp::format_name(stats.nodes_format) << ")";
+
+                std::cout << std::endl;
             }
 
+#ifndef NODEBUILDER_HEADLESS
             while (draw) {
-                renderer.clear();
-                renderer.draw_map_outline();
-                renderer.draw_text("All Nodes built.\nAll Blocks processed.");
-                renderer.show();
+                renderer->clear();
+                renderer->draw_map_outline();
+                renderer->draw_text("All Nodes built.\nAll Blocks processed.");
+                renderer->show();
 
-                if (!renderer.running())
+                if (!renderer->running())
                     break;
             }
+#endif
         }
 
         if (maps.size() > 1)
             std::cout << "\nAll maps processed in " << total_time.count() << " ms" << std::endl;
 
+        if (cache)
+            std::cout << "Build cache: " << cache->hits() << " hits, " << cache->misses() << " misses" << std::endl;
+
         std::cout << "Saving to WAD..." << std::endl;
+
+        auto write_start = std::chrono::steady_clock::now();
         wad.save("output.wad");
+
+        if (!stats_path.empty()) {
+            std::ofstream stats_file(stats_path);
+            write_stats_json(stats_file, VERSION, map_stats, elapsed(write_start));
+
+            if (!stats_file.good()) {
+                std::cerr << "Unable to write stats to " << stats_path << std::endl;
+                return 1;
+            }
+        }
     }
     catch (std::exception &e) {
         std::cerr << "Error: " << e.what() << std::endl;
@@ -17,6 +17,15 @@
 #include "wad.hpp"
 #include "common.hpp"
 #include <iostream>
+#include <type_traits>
+
+namespace {
+    // Extended nodes aren't made of whole entries, so they're told apart by their magic
+    bool is_extended_nodes(const std::string &name, const void *data, std::size_t size) {
+        auto bytes = static_cast<const std::uint8_t*>(data);
+        return name == "NODES" && size >= 4 && (std::equal(bytes, bytes + 4, "XNOD") || std::equal(bytes, bytes + 4, "ZNOD"));
+    }
+}
 
 Map::Map(const std::string &map, Wad &wad) : map_(map), wad_(wad) {
 }
@@ -121,6 +130,69 @@ bool Map::valid() const {
     return valid;
 }
 
+template <typename Self, typename Func>
+bool Map::visit_lump(Self &self, const std::string &name, Func &&func) {
+    if      (name == "THINGS")   func(self.things_);
+    else if (name == "LINEDEFS") func(self.linedefs_);
+    else if (name == "SIDEDEFS") func(self.sidedefs_);
+    else if (name == "VERTEXES") func(self.vertices_);
+    else if (name == "SEGS")     func(self.segs_);
+    else if (name == "SSECTORS") func(self.ssectors_);
+    else if (name == "NODES")    func(self.nodes_);
+    else if (name == "SECTORS")  func(self.sectors_);
+    else if (name == "REJECT")   func(self.reject_);
+    else if (name == "BLOCKMAP") func(self.blockmap_);
+    else
+        return false;
+
+    return true;
+}
+
+const std::uint8_t *Map::get_lump(const std::string &name, std::size_t &size) const {
+    const std::uint8_t *data = nullptr;
+    size = 0;
+
+    visit_lump(*this, name, [&](const auto &lump) {
+        if (lump.data) {
+            data = lump.data.get();
+            size = lump.size;
+        }
+    });
+
+    return data;
+}
+
+bool Map::replace_lump(const std::string &name, const void *data, std::size_t size) {
+    if (!can_replace_lump(name, data, size))
+        return false;
+
+    if (is_extended_nodes(name, data, size)) {
+        replace_extended_nodes(static_cast<const std::uint8_t*>(data), size);
+        return true;
+    }
+
+    visit_lump(*this, name, [&](auto &lump) {
+        using T = std::remove_const_t<std::remove_pointer_t<decltype(lump.get())>>;
+        lump.replace(static_cast<const T*>(data), size / sizeof(T));
+    });
+
+    return true;
+}
+
+bool Map::can_replace_lump(const std::string &name, const void *data, std::size_t size) const {
+    if (is_extended_nodes(name, data, size))
+        return true;
+
+    bool fits = false;
+
+    visit_lump(*this, name, [&](const auto &lump) {
+        using T = std::remove_const_t<std::remove_pointer_t<decltype(lump.get())>>;
+        fits = size % sizeof(T) == 0;
+    });
+
+    return fits;
+}
+
 Boxi Map::bounds() const {
     return bounds_;
 }
@@ -137,6 +209,14 @@ std::string Map::map() const {
     return map_;
 }
 
+bool Map::extended_nodes() const {
+    if (!nodes_.data || nodes_.size < 4)
+        return false;
+
+    auto magic = nodes_.data.get();
+    return std::equal(magic, magic + 4, "XNOD") || std::equal(magic, magic + 4, "ZNOD");
+}
+
 void Map::find_bounds() {
     if (!num_vertices()) {
         bounds_ = Box(Vec2i(0, 0), Vec2i(0, 0));
@@ -202,8 +282,10 @@ void Map::swap_byte_order() {
         ssectors->first = Common::swap16(ssectors->first);
     }
 
+    // Extended nodes are always written in little endian
     auto nodes = reinterpret_cast<Node*>(nodes_.data.get());
-    for (auto i = 0; i < num_nodes(); i++, nodes++) {
+    auto num_swapped = extended_nodes() ? 0 : num_nodes();
+    for (auto i = 0; i < num_swapped; i++, nodes++) {
         nodes->x        = Common::swap16(nodes->x);
         nodes->y        = Common::swap16(nodes->y);
         nodes->dx       = Common::swap16(nodes->dx);
@@ -141,6 +141,36 @@ public:
     void replace_reject(const Reject *reject, std::size_t num)       { reject_  .replace(reject, num); }
     void replace_blockmap(const BlockMap *blockmap, std::size_t num) { blockmap_.replace(blockmap, num); }
 
+    /**
+     * Gets a lump by name, in the same form as the typed functions
+     * @param name The name of the lump, such as "NODES"
+     * @param size Set to the size of the lump in bytes
+     * @return The data of the lump, or nullptr if there isn't one
+     */
+    const std::uint8_t *get_lump(const std::string &name, std::size_t &size) const;
+
+    /**
+     * Replaces a lump by name, in the same form as the typed functions
+     * @param name The name of the lump, such as "NODES"
+     * @param data The new data
+     * @param size The size of the data in bytes, which must be a whole number of entries
+     * @return false if the map has no lump with the name, or the size doesn't fit
+     */
+    bool replace_lump(const std::string &name, const void *data, std::size_t size);
+
+    // Whether replace_lump() would succeed, without replacing anything
+    bool can_replace_lump(const std::string &name, const void *data, std::size_t size) const;
+
+    /**
+     * Replaces the nodes with one of ZDoom's extended formats, which hold the segs, subsectors, and any new vertices too
+     * @param data The lump, starting with "XNOD" or "ZNOD"
+     * @param size The size of the lump in bytes
+     */
+    void replace_extended_nodes(const std::uint8_t *data, std::size_t size) { nodes_.replace_bytes(data, size); }
+
+    // Whether the nodes are in one of ZDoom's extended formats, in which case num_nodes() and get_nodes() don't apply
+    bool extended_nodes() const;
+
 private:
 	template <typename T>
     struct MapLump {
@@ -153,11 +183,15 @@ private:
     	}
 
         void replace(const T *data, std::size_t num) {
+            replace_bytes(reinterpret_cast<const std::uint8_t*>(data), num * sizeof(T));
+        }
+
+        void replace_bytes(const std::uint8_t *data, std::size_t size) {
             this->changed = true;
-            this->size    = num * sizeof(T);
+            this->size    = size;
             this->data    = std::make_unique<std::uint8_t[]>(size);
 
-            std::copy_n(reinterpret_cast<const std::uint8_t*>(data), this->size, this->data.get());
+            std::copy_n(data, size, this->data.get());
         }
 
         bool changed;
@@ -168,6 +202,10 @@ private:
     void find_bounds();
     void swap_byte_order();
 
+    // Calls a function with the lump that has a name, returning false if there isn't one
+    template <typename Self, typename Func>
+    static bool visit_lump(Self &self, const std::string &name, Func &&func);
+
     Wad &wad_;
     std::string map_;
     Boxi bounds_;
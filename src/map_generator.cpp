@@ -0,0 +1,433 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "map_generator.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    const char *topology_names[] = { "grid", "polygons", "spiral", "collinear", "diagonals" };
+
+    const double pi = 3.14159265358979323846;
+
+    void set_name(char *dest, const char *name) {
+        std::fill_n(dest, 8, 0);
+        std::copy_n(name, std::min<std::size_t>(std::char_traits<char>::length(name), 8), dest);
+    }
+
+    // Twice the signed area, which is positive when the points go anticlockwise
+    std::int64_t area(const std::vector<MapGenerator::Point> &points) {
+        std::int64_t area = 0;
+
+        for (std::size_t i = 0; i < points.size(); i++) {
+            const auto &p1 = points[i];
+            const auto &p2 = points[(i + 1) % points.size()];
+
+            area += static_cast<std::int64_t>(p1.first) * p2.second - static_cast<std::int64_t>(p2.first) * p1.second;
+        }
+
+        return area;
+    }
+
+    // Removes points that are the same as the one before, which rounding can make
+    void remove_repeats(std::vector<MapGenerator::Point> &points) {
+        points.erase(std::unique(points.begin(), points.end()), points.end());
+
+        while (points.size() > 1 && points.front() == points.back())
+            points.pop_back();
+    }
+
+    // The same numbers for a seed everywhere, unlike the standard distributions
+    int random(std::mt19937 &engine, int min, int max) {
+        return min + static_cast<int>(engine() % static_cast<std::uint32_t>(max - min + 1));
+    }
+
+    MapGenerator::Point polar(double radius, double angle, double x = 0, double y = 0) {
+        return { static_cast<int>(std::lround(x + radius * std::cos(angle))), static_cast<int>(std::lround(y + radius * std::sin(angle))) };
+    }
+}
+
+MapGenerator::MapGenerator() {
+}
+
+MapGenerator MapGenerator::generate(Topology topology, int linedefs, unsigned int seed) {
+    MapGenerator generator;
+    linedefs = std::max(linedefs, 1);
+
+    switch (topology) {
+    case Topology::Grid: {
+        // Each room has six lines, besides the ones on the outside
+        int rooms = std::lround((std::sqrt(4.0 + 24.0 * linedefs) - 2) / 12);
+        generator.grid_of_rooms(std::max(rooms, 1), std::max(rooms, 1));
+        break;
+    }
+    case Topology::Polygons:
+        // Polygons have eight and a half sides on average
+        generator.random_polygons(std::max(std::lround((linedefs - 4) / 8.5), 1l), seed);
+        break;
+    case Topology::Spiral:
+        generator.spiral(std::max((linedefs - 2) / 2, 2));
+        break;
+    case Topology::Collinear: {
+        // Each pillar has four lines, and adds three to the walls
+        int pillars = std::lround((std::sqrt(144.0 + 16.0 * linedefs) - 12) / 8);
+        generator.collinear_pillars(std::max(pillars, 1), std::max(pillars, 1));
+        break;
+    }
+    case Topology::Diagonals: {
+        int pillars = std::lround(std::sqrt(std::max(linedefs - 4, 3) / 3.0));
+        generator.diagonals(std::max(pillars, 1), std::max(pillars, 1), seed);
+        break;
+    }
+    }
+
+    return generator;
+}
+
+bool MapGenerator::parse_topology(const std::string &name, Topology &topology) {
+    for (std::size_t i = 0; i < sizeof(topology_names) / sizeof(topology_names[0]); i++) {
+        if (name == topology_names[i]) {
+            topology = static_cast<Topology>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::string MapGenerator::topology_name(Topology topology) {
+    return topology_names[static_cast<int>(topology)];
+}
+
+void MapGenerator::grid_of_rooms(int columns, int rows, int size) {
+    int first = sectors_.size();
+
+    for (int i = 0; i < columns * rows; i++)
+        sector(0, 128);
+
+    auto room = [&](int column, int row) {
+        return first + row * columns + column;
+    };
+
+    int width  = columns * size;
+    int height = rows * size;
+
+    // The walls between rooms, with the room to the right or above in front
+    for (int row = 0; row < rows; row++) {
+        for (int column = 1; column < columns; column++) {
+            int x = column * size;
+            line(x, row * size, x, (row + 1) * size, room(column, row), room(column - 1, row));
+        }
+    }
+
+    for (int row = 1; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            int y = row * size;
+            line((column + 1) * size, y, column * size, y, room(column, row), room(column, row - 1));
+        }
+    }
+
+    // The outside walls, going clockwise a room at a time
+    for (int row = 0; row < rows; row++) {
+        line(0, row * size, 0, (row + 1) * size, room(0, row));
+        line(width, (row + 1) * size, width, row * size, room(columns - 1, row));
+    }
+
+    for (int column = 0; column < columns; column++) {
+        line(column * size, height, (column + 1) * size, height, room(column, rows - 1));
+        line((column + 1) * size, 0, column * size, 0, room(column, 0));
+    }
+
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            int x1 = column * size + size * 3 / 8, x2 = column * size + size * 5 / 8;
+            int y1 = row * size + size * 3 / 8,    y2 = row * size + size * 5 / 8;
+
+            pillar({ { x1, y1 }, { x2, y1 }, { x2, y2 }, { x1, y2 } }, room(column, row));
+        }
+    }
+
+    player_start(size / 8, size / 8);
+}
+
+void MapGenerator::random_polygons(int count, unsigned int seed) {
+    const int cell = 256;
+
+    std::mt19937 engine(seed);
+    int cells = static_cast<int>(std::ceil(std::sqrt(count)));
+
+    int outside = sector(0, 128);
+    room(0, 0, cells * cell, cells * cell, outside);
+
+    for (int i = 0; i < count; i++) {
+        double x = (i % cells) * cell + cell / 2;
+        double y = (i / cells) * cell + cell / 2;
+
+        // Spreading the corners evenly around the middle stops the sides from crossing
+        int sides = random(engine, 5, 12);
+        std::vector<Point> points;
+
+        for (int j = 0; j < sides; j++) {
+            double angle = (j + random(engine, 0, 49) / 100.0) * 2 * pi / sides;
+            points.push_back(polar(random(engine, 40, 110), angle, x, y));
+        }
+
+        loop(points, sector(random(engine, 0, 4) * 8, 128), outside);
+    }
+
+    player_start(16, 16);
+}
+
+void MapGenerator::spiral(int lines) {
+    const double start   = 128; // The radius of the middle of the corridor, where it starts
+    const double spacing = 128; // How far apart each turn is
+    const double width   = 64;  // The width of the corridor
+    const double length  = 24;  // The length of each line along the outside wall
+
+    double growth = spacing / (2 * pi);
+    std::vector<Point> outer, inner;
+
+    // Step round by the same length along the outside wall each time
+    double angle = 0;
+    for (int i = 0; i <= lines; i++) {
+        double radius = start + growth * angle;
+
+        outer.push_back(polar(radius + width / 2, angle));
+        inner.push_back(polar(radius - width / 2, angle));
+
+        angle += length / (radius + width / 2);
+    }
+
+    // Go out along one wall and back along the other
+    std::vector<Point> points = outer;
+    points.insert(points.end(), inner.rbegin(), inner.rend());
+
+    loop(points, sector(0, 128));
+
+    auto start_point = polar(start, length / start);
+    player_start(start_point.first, start_point.second);
+}
+
+void MapGenerator::collinear_pillars(int columns, int rows) {
+    const int cell = 48, size = 16;
+
+    int inside = sector(0, 128);
+    room(0, 0, columns * cell, rows * cell, inside, size);
+
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            int x1 = column * cell + size, x2 = x1 + size;
+            int y1 = row * cell + size,    y2 = y1 + size;
+
+            pillar({ { x1, y1 }, { x2, y1 }, { x2, y2 }, { x1, y2 } }, inside);
+        }
+    }
+
+    player_start(size / 2, size / 2);
+}
+
+void MapGenerator::diagonals(int columns, int rows, unsigned int seed) {
+    const int cell = 48, radius = 16;
+
+    std::mt19937 engine(seed);
+
+    int inside = sector(0, 128);
+    room(0, 0, columns * cell, rows * cell, inside);
+
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            double x = column * cell + cell / 2;
+            double y = row * cell + cell / 2;
+            double angle = random(engine, 0, 359) * pi / 180;
+
+            std::vector<Point> points;
+            for (int i = 0; i < 3; i++)
+                points.push_back(polar(radius, angle + i * 2 * pi / 3, x, y));
+
+            pillar(points, inside);
+        }
+    }
+
+    player_start(4, 4);
+}
+
+void MapGenerator::write(Wad &wad, const std::string &name) const {
+    static const char *lump_names[] = {
+        "THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS",
+        "SSECTORS", "NODES", "SECTORS", "REJECT", "BLOCKMAP"
+    };
+
+    // Add any missing lumps empty, so that the map can fill them in
+    std::size_t size;
+    if (!wad.read(name, size)) {
+        wad.add(name, nullptr, 0);
+        for (auto lump : lump_names)
+            wad.add(lump, nullptr, 0);
+    }
+
+    // Let the map take care of the byte order
+    Map map(name, wad);
+    map.load();
+
+    map.replace_things(things_.data(), things_.size());
+    map.replace_linedefs(linedefs_.data(), linedefs_.size());
+    map.replace_sidedefs(sidedefs_.data(), sidedefs_.size());
+    map.replace_vertices(vertices_.data(), vertices_.size());
+    map.replace_sectors(sectors_.data(), sectors_.size());
+    map.save();
+}
+
+std::uint16_t MapGenerator::vertex(int x, int y) {
+    auto found = vertex_table_.find({ x, y });
+    if (found != vertex_table_.end())
+        return found->second;
+
+    if (vertices_.size() >= 0xffff)
+        throw std::runtime_error("Too many vertices in generated map");
+
+    if (x < -0x8000 || x > 0x7fff || y < -0x8000 || y > 0x7fff)
+        throw std::runtime_error("Generated map is too big");
+
+    Map::Vertex vertex;
+    vertex.x = x;
+    vertex.y = y;
+
+    vertices_.push_back(vertex);
+    vertex_table_.emplace(Point(x, y), vertices_.size() - 1);
+
+    return vertices_.size() - 1;
+}
+
+std::uint16_t MapGenerator::sector(int floor, int ceiling) {
+    if (sidedefs_.size() + 2 > 0xffff)
+        throw std::runtime_error("Too many sidedefs in generated map");
+
+    Map::Sector sector = {};
+    sector.floorh = floor;
+    sector.ceilh  = ceiling;
+    sector.light  = 160;
+    set_name(sector.floor_tex, "FLOOR4_8");
+    set_name(sector.ceil_tex, "CEIL3_5");
+
+    sectors_.push_back(sector);
+
+    // One sidedef for walls, and one for openings into other sectors, which may have steps
+    SectorSides sides;
+    for (auto texture : { "STARTAN3", "-" }) {
+        Map::SideDef side = {};
+        set_name(side.upper, "STARTAN3");
+        set_name(side.lower, "STARTAN3");
+        set_name(side.middle, texture);
+        side.sector = sectors_.size() - 1;
+
+        sidedefs_.push_back(side);
+    }
+
+    sides.wall = sidedefs_.size() - 2;
+    sides.open = sidedefs_.size() - 1;
+    sector_sides_.push_back(sides);
+
+    return sectors_.size() - 1;
+}
+
+void MapGenerator::line(int x1, int y1, int x2, int y2, int front, int back) {
+    if (linedefs_.size() >= 0xffff)
+        throw std::runtime_error("Too many linedefs in generated map");
+
+    Map::LineDef linedef = {};
+    linedef.start = vertex(x1, y1);
+    linedef.end   = vertex(x2, y2);
+
+    if (back < 0) {
+        linedef.flags      = 0x0001; // Impassable
+        linedef.sidedef[0] = sector_sides_[front].wall;
+        linedef.sidedef[1] = 0xffff;
+    }
+    else {
+        linedef.flags      = 0x0004; // Two sided
+        linedef.sidedef[0] = sector_sides_[front].open;
+        linedef.sidedef[1] = sector_sides_[back].open;
+    }
+
+    linedefs_.push_back(linedef);
+}
+
+void MapGenerator::loop(std::vector<Point> points, int inside, int outside) {
+    remove_repeats(points);
+
+    // Clockwise puts the inside on the right
+    if (area(points) > 0)
+        std::reverse(points.begin(), points.end());
+
+    for (std::size_t i = 0; i < points.size(); i++) {
+        const auto &p1 = points[i];
+        const auto &p2 = points[(i + 1) % points.size()];
+
+        line(p1.first, p1.second, p2.first, p2.second, inside, outside);
+    }
+}
+
+void MapGenerator::pillar(std::vector<Point> points, int outside) {
+    remove_repeats(points);
+
+    // Anticlockwise puts the outside on the right
+    if (area(points) < 0)
+        std::reverse(points.begin(), points.end());
+
+    for (std::size_t i = 0; i < points.size(); i++) {
+        const auto &p1 = points[i];
+        const auto &p2 = points[(i + 1) % points.size()];
+
+        line(p1.first, p1.second, p2.first, p2.second, outside);
+    }
+}
+
+void MapGenerator::room(int x1, int y1, int x2, int y2, int sector, int length) {
+    Point corners[] = { { x1, y1 }, { x1, y2 }, { x2, y2 }, { x2, y1 } };
+    std::vector<Point> points;
+
+    for (int i = 0; i < 4; i++) {
+        const auto &p1 = corners[i];
+        const auto &p2 = corners[(i + 1) % 4];
+
+        int span  = std::max(std::abs(p2.first - p1.first), std::abs(p2.second - p1.second));
+        int steps = (span + length - 1) / length;
+
+        for (int step = 0; step < steps; step++) {
+            points.emplace_back(p1.first + (p2.first - p1.first) * step / steps,
+                                p1.second + (p2.second - p1.second) * step / steps);
+        }
+    }
+
+    loop(points, sector);
+}
+
+void MapGenerator::player_start(int x, int y) {
+    if (!things_.empty())
+        return;
+
+    Map::Thing player = {};
+    player.x     = x;
+    player.y     = y;
+    player.angle = 45;
+    player.type  = 1;
+    player.flags = 0x0007;
+
+    things_.push_back(player);
+}
@@ -0,0 +1,139 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "map.hpp"
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+
+class Wad;
+
+// Builds synthetic maps out of sectors and lines, for benchmarks and testing
+class MapGenerator
+{
+public:
+    enum class Topology {
+        Grid,      // Square rooms joined by two sided lines, with a pillar in each
+        Polygons,  // Random polygon sectors inside one big room
+        Spiral,    // A corridor winding outwards, made of short lines at every angle
+        Collinear, // Rows of small pillars, with the edges of each row on the same lines
+        Diagonals  // Small triangular pillars turned to random angles
+    };
+
+    using Point = std::pair<int, int>;
+
+    MapGenerator();
+
+    /**
+     * Creates a map of a topology with about a number of linedefs
+     * @param topology The layout of the map
+     * @param linedefs The number of linedefs to aim for
+     * @param seed Used by the random layouts, which are the same for the same seed
+     * @return The generator with the map in it
+     */
+    static MapGenerator generate(Topology topology, int linedefs, unsigned int seed = 1);
+
+    /**
+     * Finds a topology by its name, such as "grid"
+     * @param name The name of the topology
+     * @param topology Set to the topology if it's found
+     * @return false if there isn't one with the name
+     */
+    static bool parse_topology(const std::string &name, Topology &topology);
+    static std::string topology_name(Topology topology);
+
+    /**
+     * Adds a grid of square rooms, joined by two sided lines, with a pillar in the middle of each one
+     * @param columns The number of rooms across
+     * @param rows The number of rooms down
+     * @param size The width of each room
+     */
+    void grid_of_rooms(int columns, int rows, int size = 128);
+
+    /**
+     * Adds a room full of star shaped sectors, each with a random number of sides and floor height
+     * @param count The number of sectors to add
+     * @param seed The seed for the random numbers
+     */
+    void random_polygons(int count, unsigned int seed);
+
+    /**
+     * Adds a corridor that spirals outwards, with each wall cut into short lines
+     * @param lines The number of lines along each wall
+     */
+    void spiral(int lines);
+
+    /**
+     * Adds a room with a grid of small square pillars, with its walls cut into lines the same length as a pillar
+     * @param columns The number of pillars across
+     * @param rows The number of pillars down
+     */
+    void collinear_pillars(int columns, int rows);
+
+    /**
+     * Adds a room with a grid of small triangular pillars, each turned to a random angle
+     * @param columns The number of pillars across
+     * @param rows The number of pillars down
+     * @param seed The seed for the random numbers
+     */
+    void diagonals(int columns, int rows, unsigned int seed);
+
+    /**
+     * Adds the map to a WAD, replacing the lumps if it's already there
+     * @param wad The WAD to add it to
+     * @param name The name of the map, such as "MAP01"
+     */
+    void write(Wad &wad, const std::string &name) const;
+
+    std::size_t num_linedefs() const { return linedefs_.size(); }
+    std::size_t num_vertices() const { return vertices_.size(); }
+    std::size_t num_sectors() const  { return sectors_.size(); }
+
+private:
+    // The sidedefs of a sector are shared between all its lines, which keeps big maps under the limit
+    struct SectorSides {
+        std::uint16_t wall;
+        std::uint16_t open;
+    };
+
+    std::uint16_t vertex(int x, int y);
+    std::uint16_t sector(int floor, int ceiling);
+
+    // Adds a line with the front sector on its right, and no back sector if it's negative
+    void line(int x1, int y1, int x2, int y2, int front, int back = -1);
+
+    // Adds lines around a polygon with the sector inside on their right, and the one outside behind them
+    void loop(std::vector<Point> points, int inside, int outside = -1);
+
+    // Adds one sided lines around a pillar, with the sector outside on their right
+    void pillar(std::vector<Point> points, int outside);
+
+    // Adds the walls of a rectangular room, cut into lines of at most a length
+    void room(int x1, int y1, int x2, int y2, int sector, int length = 0x7fff);
+
+    void player_start(int x, int y);
+
+    std::vector<Map::Thing> things_;
+    std::vector<Map::LineDef> linedefs_;
+    std::vector<Map::SideDef> sidedefs_;
+    std::vector<Map::Vertex> vertices_;
+    std::vector<Map::Sector> sectors_;
+    std::vector<SectorSides> sector_sides_;
+
+    std::map<Point, std::uint16_t> vertex_table_;
+};
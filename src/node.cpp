@@ -14,152 +14,870 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "node.hpp"
-#include "renderer.hpp"
+#include "thread_pool.hpp"
 #include <climits>
-#include "SDL.h"
+#include <exception>
+#include <algorithm>
+#include <unordered_set>
+#include <map>
+#include <numeric>
 
-Node::Node() : left_(nullptr), right_(nullptr) {
+Node::Node() : left_(0), right_(0), first_seg_(0), num_segs_(0) {
 }
 
-Node::Node(const std::vector<Seg> &segs, const Polyf &poly, Renderer &renderer, int &num_nodes, int &num_segs, int &num_ssectors) : left_(nullptr), right_(nullptr) {
-    create(segs, poly, renderer, num_nodes, num_segs, num_ssectors);
+void Node::create(unsigned int index, std::vector<unsigned int> segs, const Polyf &poly, Context &context) {
+    NullObserver null_observer;
+
+    if (context.options.exact) {
+        if (context.observer)
+            build_tree<ExactPredicate>(index, std::move(segs), poly, context, *context.observer);
+        else
+            build_tree<ExactPredicate>(index, std::move(segs), poly, context, null_observer);
+    }
+    else {
+        if (context.observer)
+            build_tree<FloatPredicate>(index, std::move(segs), poly, context, *context.observer);
+        else
+            build_tree<FloatPredicate>(index, std::move(segs), poly, context, null_observer);
+    }
 }
 
-Node::~Node() {
-    if (left_)  delete left_;
-    if (right_) delete right_;
+unsigned int Node::rebuild(unsigned int index, std::vector<unsigned int> kept, std::vector<unsigned int> added, std::vector<unsigned int> removed, Context &context) {
+    Rebuild root{index, 0, std::move(kept), std::move(added), std::move(removed)};
+
+    if (context.options.exact)
+        return rebuild_tree<ExactPredicate>(std::move(root), context);
+    else
+        return rebuild_tree<FloatPredicate>(std::move(root), context);
 }
 
-void Node::create(const std::vector<Seg> &segs, const Polyf &poly, Renderer &renderer, int &num_nodes, int &num_segs, int &num_ssectors) {
-    if (!renderer.running())
-        return;
+unsigned int Node::compact(unsigned int index, SegPool &seg_pool, NodePool &nodes, LeafSegPool &leaf_segs) {
+    // Copy the tree out, giving each node its new index as it's reached
+    std::vector<Node> tree = { nodes[index] };
+    std::vector<unsigned int> tree_leaf_segs;
 
-    num_nodes++;
+    for (std::size_t i = 0; i < tree.size(); i++) {
+        if (tree[i].leaf()) {
+            auto first = tree[i].first_seg_;
+            tree[i].first_seg_ = tree_leaf_segs.size();
 
-    // Find the bounding box of this node
-    bounds_ = Boxf(segs[0].p1(), segs[0].p1());
-    for (const auto &seg :segs) {
-        bounds_.extend(seg.p1());
-        bounds_.extend(seg.p2());
+            for (unsigned int j = 0; j < tree[i].num_segs_; j++)
+                tree_leaf_segs.push_back(leaf_segs[first + j]);
+        }
+        else {
+            auto left = tree[i].left_, right = tree[i].right_;
+
+            tree[i].left_ = tree.size();
+            tree.push_back(nodes[left]);
+            tree[i].right_ = tree.size();
+            tree.push_back(nodes[right]);
+        }
     }
 
-    renderer.clear();
-    renderer.draw_map();
+    std::vector<unsigned int> tree_segs = tree_leaf_segs;
+    std::sort(tree_segs.begin(), tree_segs.end());
+    tree_segs.erase(std::unique(tree_segs.begin(), tree_segs.end()), tree_segs.end());
+
+    std::vector<Seg> segs;
+    segs.reserve(tree_segs.size());
+    for (auto seg : tree_segs)
+        segs.push_back(seg_pool[seg]);
+
+    for (auto &seg : tree_leaf_segs)
+        seg = std::lower_bound(tree_segs.begin(), tree_segs.end(), seg) - tree_segs.begin();
+
+    seg_pool.clear();
+    nodes.clear();
+    leaf_segs.clear();
 
     for (const auto &seg : segs)
-        renderer.draw_line(seg.line());
+        seg_pool.add(seg);
+    for (const auto &node : tree)
+        nodes.add(node);
+    for (auto seg : tree_leaf_segs)
+        leaf_segs.add(seg);
 
-    renderer.draw_poly(poly);
+    return 0;
+}
 
-    int best_score = INT_MAX;
-    int splitter   = 0;
+template <typename Predicate>
+unsigned int Node::rebuild_tree(Rebuild root, Context &context) {
+    auto &seg_pool = context.seg_pool;
 
-    // Find the best splitter
-    for (auto i = 0; i < segs.size(); i++) {
-        int score = splitter_score(segs, i);
+    // Cutting the same segs with the same splitters always gives the same pieces, so the old tree is still right
+    if (!root.changed())
+        return root.old_node;
 
-        if (score < best_score) {
-            best_score = score;
-            splitter   = i;
+    root.node = context.nodes.allocate(1);
+    auto new_root = root.node;
+
+    std::vector<Rebuild> stack;
+    stack.push_back(std::move(root));
+
+    while (!stack.empty()) {
+        auto work = std::move(stack.back());
+        stack.pop_back();
+
+        const auto &old = context.nodes[work.old_node];
+        auto &node      = context.nodes[work.node];
+
+        // The old splitter can be kept if not too much has changed, as long as it still splits the node
+        bool keep = !old.leaf() && (work.added.size() + work.removed.size()) * rebuild_ratio <= work.kept.size() + work.removed.size();
+
+        if (keep) {
+            bool front = false, back = false;
+
+            for (const auto *segs : {&work.kept, &work.added}) {
+                for (auto index : *segs) {
+                    int side = old.splitter_.template side_of<Predicate>(seg_pool[index]);
+                    front |= side <= 0;
+                    back  |= side >= 0;
+                }
+            }
+
+            keep = front && back;
+        }
+
+        if (!keep) {
+            std::vector<unsigned int> segs = std::move(work.kept);
+            segs.insert(segs.end(), work.added.begin(), work.added.end());
+
+            // Keep the segs in the order they were made, so that rebuilding from the root gives the same tree as a full build
+            std::sort(segs.begin(), segs.end());
+
+            create(work.node, std::move(segs), Polyf(), context);
+            continue;
         }
+
+        context.num_nodes++;
+
+        auto first = work.kept.empty() ? work.added[0] : work.kept[0];
+
+        node.splitter_ = old.splitter_;
+        node.bounds_   = Boxf(seg_pool[first].p1(), seg_pool[first].p1());
+
+        for (const auto *segs : {&work.kept, &work.added}) {
+            for (auto index : *segs) {
+                node.bounds_.extend(seg_pool[index].p1());
+                node.bounds_.extend(seg_pool[index].p2());
+            }
+        }
+
+        // Split every list the same way as the old tree did
+        Rebuild front{old.left_, 0, {}, {}, {}}, back{old.right_, 0, {}, {}, {}};
+        SegBuffer buffer;
+
+        auto split_list = [&](std::vector<unsigned int> &segs, std::vector<unsigned int> &front_segs, std::vector<unsigned int> &back_segs) {
+            buffer.assign(seg_pool, segs);
+            context.num_cuts += split_segs<Predicate>(node.splitter_, seg_pool, segs, buffer, segs.size(), back_segs);
+            front_segs = std::move(segs);
+        };
+
+        split_list(work.kept,    front.kept,    back.kept);
+        split_list(work.added,   front.added,   back.added);
+        split_list(work.removed, front.removed, back.removed);
+
+        // Only the sides that changed need new nodes
+        for (auto *child : {&front, &back}) {
+            if (child->changed()) {
+                child->node = context.nodes.allocate(1);
+                stack.push_back(std::move(*child));
+            }
+            else
+                child->node = child->old_node;
+        }
+
+        node.left_  = front.node;
+        node.right_ = back.node;
+    }
+
+    return new_root;
+}
+
+template <typename Predicate, typename Observer>
+void Node::build_tree(unsigned int index, std::vector<unsigned int> segs, const Polyf &poly, Context &context, Observer &observer) {
+    // Every sub-tree handed to another thread joins this group, so there's only ever one wait
+    ThreadPool::Group group;
+    std::exception_ptr error;
+
+    std::vector<Work> stack;
+    stack.push_back(Work{index, std::move(segs), poly});
+
+    try {
+        build<Predicate>(stack, context, observer, group);
+    }
+    catch (...) {
+        error = std::current_exception();
     }
 
+    // The other threads still refer to the group, so it has to be waited on even if something went wrong
+    if (context.pool)
+        context.pool->wait(group);
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+template <typename Predicate, typename Observer>
+void Node::build(std::vector<Work> &stack, Context &context, Observer &observer, ThreadPool::Group &group) {
+    while (!stack.empty()) {
+        if (!observer.running())
+            return;
+
+        // Anything looked ahead at after the deadline can't be used
+        if (context.lookahead && std::chrono::steady_clock::now() >= context.deadline)
+            return;
+
+        auto work  = std::move(stack.back());
+        auto &node = context.nodes[work.node];
+        stack.pop_back();
+
+        Work front, back;
+
+        if (!node.template partition<Predicate>(work, context, observer, front, back))
+            continue;
+
+        auto total = front.segs.size() + back.segs.size();
+
+        // The front gets popped first, the same order as a recursive build
+        stack.push_back(std::move(back));
+
+        // Small sub-trees aren't worth the overhead of a task
+        if (!context.pool || total < parallel_threshold) {
+            stack.push_back(std::move(front));
+            continue;
+        }
+
+        // Both sides are independent, so let another thread steal the front while we build the back
+        context.pool->run(group, [front = std::move(front), &context, &observer, &group]() mutable {
+            std::vector<Work> stack;
+            stack.push_back(std::move(front));
+
+            build<Predicate>(stack, context, observer, group);
+        });
+    }
+}
+
+template <typename Predicate, typename Observer>
+bool Node::partition(Work &work, Context &context, Observer &observer, Work &front, Work &back) {
+    auto &seg_pool = context.seg_pool;
+    auto &segs     = work.segs;
+    auto &poly     = work.poly;
+
+    context.num_nodes++;
+
+    // Find the bounding box of this node
+    bounds_ = Boxf(seg_pool[segs[0]].p1(), seg_pool[segs[0]].p1());
+    for (auto index : segs) {
+        bounds_.extend(seg_pool[index].p1());
+        bounds_.extend(seg_pool[index].p2());
+    }
+
+    if constexpr (Observer::active) {
+        std::vector<Linef> lines;
+        for (auto index : segs)
+            lines.push_back(seg_pool[index].line());
+
+        observer.node_started(lines, poly);
+    }
+
+    // Copy the segs into a form that can be classified in bulk
+    // This is finished with before building either child, so each thread can keep reusing the same one
+    static thread_local SegBuffer buffer;
+    buffer.assign(seg_pool, segs);
+
+    int best_score;
+    unsigned int splitter;
+    Effort effort;
+
+    if (looks_ahead(work, context)) {
+        choose_splitter<Predicate>(segs, buffer, context, effort, best_score, splitter);
+
+        // Looking ahead builds other nodes on this thread, which reuse the buffer
+        buffer.assign(seg_pool, segs);
+    }
+    else
+        find_splitter<Predicate>(seg_pool, segs, buffer, context.pool, context.options.heuristic, effort, best_score, splitter);
+
+    context.num_candidates += effort.candidates;
+    context.num_classified += effort.classified;
+
     // If no lines where split, then this is a leaf node
     if (best_score == INT_MAX) {
-        segs_  = segs;
-        renderer.add_poly(carve(segs, poly), Color::random());
-        
-        num_segs += segs.size();
-        num_ssectors++;
+        if constexpr (Observer::active)
+            observer.leaf_created(carve<Predicate>(seg_pool, segs, poly));
 
-        return;
+        context.num_segs += segs.size();
+        context.num_ssectors++;
+
+        // Copy the segs into the tree, as the list is only temporary
+        first_seg_ = context.leaf_segs.allocate(segs.size());
+        num_segs_  = segs.size();
+
+        for (std::size_t i = 0; i < segs.size(); i++)
+            context.leaf_segs[first_seg_ + i] = segs[i];
+
+        return false;
     }
 
-    renderer.draw_splitter(Splitter(segs[splitter]));
-    
-    // Draw some stats
-    renderer.draw_text(
-        std::string("Building Nodes...") +
-        "\nNode    #: " + std::to_string(num_nodes) +
-        "\nSeg     #: " + std::to_string(num_segs) +
-        "\nSSector #: " + std::to_string(num_ssectors)
-    );
-    
-    renderer.show();
+    if constexpr (Observer::active)
+        observer.node_split(Splitter(seg_pool[segs[splitter]]), context.num_nodes, context.num_segs, context.num_ssectors);
+
+    // Now actually split the node, with the front segs left in this node's list
+    context.num_classified += segs.size() * 2;
+    context.num_cuts       += split<Predicate>(seg_pool, segs, buffer, splitter, back.segs);
 
-    // Now actually split the node
-    std::vector<Seg> front_segs, back_segs;
-    split(segs, splitter, front_segs, back_segs);
-    auto polys = Splitter(segs[splitter]).cut(poly);
+    // Both children are added together, and never move once they're in the pool
+    left_  = context.nodes.allocate(2);
+    right_ = left_ + 1;
 
-    left_  = new Node(front_segs, polys.second, renderer, num_nodes, num_segs, num_ssectors);
-    right_ = new Node(back_segs, polys.first, renderer, num_nodes, num_segs, num_ssectors);
+    front.node  = left_;
+    front.segs  = std::move(segs);
+    front.depth = work.depth + 1;
+    back.node   = right_;
+    back.depth  = work.depth + 1;
+
+    // The areas covered by the nodes are only for showing the progress, so don't bother without an observer
+    if constexpr (Observer::active) {
+        auto polys = splitter_.cut<Predicate>(poly);
+
+        front.poly = std::move(polys.second);
+        back.poly  = std::move(polys.first);
+    }
+
+    return true;
 }
 
-int Node::splitter_score(const std::vector<Seg> &segs, unsigned int splitter_index) const {
-    Splitter splitter(segs[splitter_index]);
+template <typename Predicate>
+void Node::gather_splitters(const SegPool &seg_pool, const std::vector<unsigned int> &segs, std::vector<unsigned int> &candidates, Sweeps &sweeps) {
+    std::unordered_set<unsigned int> groups;
 
-    int front_count = 0;
-    int back_count  = 0;
+    candidates.reserve(segs.size());
+
+    for (std::size_t i = 0; i < segs.size(); i++) {
+        // Collinear segs going the same way all split the node the same way, so only the first seg of each group needs to be scored
+        // That's only true of the float predicate for axis-aligned segs, as its rounding depends on where the seg starts
+        const auto &seg = seg_pool[segs[i]];
+        auto dir = direction(seg);
 
-    for (auto i = 0; i < segs.size(); i++) {
-        if (i == splitter_index) {
-            front_count++;
+        bool same_split = Predicate::exact || !seg.dx() || !seg.dy();
+        if (seg.group() != Seg::no_group && same_split && !groups.insert(seg.group()).second)
             continue;
+
+        // Only splitters that classify segs the same way from anywhere along their line can be swept
+        if ((dir.first || dir.second) && (Predicate::exact || !dir.first || !dir.second))
+            sweeps[dir].push_back(i);
+        else
+            candidates.push_back(i);
+    }
+}
+
+template <typename Predicate>
+void Node::find_splitter(const SegPool &seg_pool, const std::vector<unsigned int> &segs, const SegBuffer &buffer, ThreadPool *pool, Heuristic heuristic, Effort &effort, int &best_score, unsigned int &splitter) const {
+    std::vector<unsigned int> candidates; // Scored one at a time
+    Sweeps sweeps;
+    gather_splitters<Predicate>(seg_pool, segs, candidates, sweeps);
+
+    best_score = INT_MAX;
+    splitter   = 0;
+
+    // The lowest score wins, with the lowest index breaking any ties
+    auto consider = [&](int score, unsigned int index) {
+        if (score < best_score || (score == best_score && index < splitter)) {
+            best_score = score;
+            splitter   = index;
         }
+    };
 
-        int side = splitter.side_of(segs[i]);
+    // Score every splitter going in the same direction at once
+    std::vector<int> scores;
 
-        if (side == -1)
-            front_count++;
-        else if (side == 1)
-            back_count++;
-        else {
-            front_count++;
-            back_count++;
+    for (auto &[dir, sweep] : sweeps) {
+        // Not worth it for only a few splitters
+        if (sweep.size() < sweep_threshold) {
+            candidates.insert(candidates.end(), sweep.begin(), sweep.end());
+            continue;
         }
+
+        sweep_scores(seg_pool, segs, heuristic, dir.first, dir.second, sweep, scores);
+
+        // Both ends of every seg get placed among the splitters
+        effort.candidates += sweep.size();
+        effort.classified += segs.size() * 2;
+
+        for (std::size_t i = 0; i < sweep.size(); i++)
+            consider(scores[i], sweep[i]);
     }
 
-    // No lines intersect
-    if (!front_count || !back_count)
-        return INT_MAX;
+    // Keep the candidates in order, so that earlier ones win ties within a chunk
+    std::sort(candidates.begin(), candidates.end());
+
+    // The best score found by any chunk so far, which only ever decreases
+    std::atomic<int> shared_score(best_score);
+
+    // Finds the best splitter in a range of candidates
+    auto search = [&](std::size_t begin, std::size_t end, int &best_score, unsigned int &splitter, std::uint64_t &classified) {
+        best_score = INT_MAX;
+        splitter   = 0;
+
+        for (auto i = begin; i < end; i++) {
+            // Anything scoring the same as an earlier candidate can't win, but others only beat us on a lower score
+            int bound = std::min(best_score - 1, shared_score.load(std::memory_order_relaxed));
+            int score = splitter_score<Predicate>(seg_pool, segs, buffer, heuristic, candidates[i], classified, bound);
+
+            if (score < best_score) {
+                best_score = score;
+                splitter   = candidates[i];
+
+                int shared = shared_score.load(std::memory_order_relaxed);
+                while (score < shared && !shared_score.compare_exchange_weak(shared, score, std::memory_order_relaxed));
+            }
+        }
+    };
+
+    // Score the rest of the candidates, in parallel chunks if there's enough of them
+    std::size_t chunks = pool && candidates.size() >= parallel_scoring_threshold ? pool->size() * 4 : 1;
+    std::vector<std::pair<int, unsigned int>> results(chunks);
+    std::vector<std::uint64_t> classified(chunks, 0);
+
+    if (chunks == 1)
+        search(0, candidates.size(), results[0].first, results[0].second, classified[0]);
+    else {
+        pool->parallel_for(candidates.size(), results.size(), [&](std::size_t begin, std::size_t end, std::size_t chunk) {
+            search(begin, end, results[chunk].first, results[chunk].second, classified[chunk]);
+        });
+    }
 
-    int new_lines = front_count + back_count - segs.size();
-    int diff = std::abs(front_count - back_count);
+    effort.candidates += candidates.size();
+    for (auto count : classified)
+        effort.classified += count;
+
+    // Then combine them, so the result doesn't depend on the thread count
+    for (const auto &[score, index] : results)
+        consider(score, index);
+}
 
-    return diff + new_lines*8;
+bool Node::looks_ahead(const Work &work, const Context &context) {
+    return context.options.quality_budget.count() > 0 && !context.lookahead && work.depth < context.options.beam_depth
+        && std::chrono::steady_clock::now() < context.deadline;
 }
 
-void Node::split(const std::vector<Seg> &segs, unsigned int splitter_index, std::vector<Seg> &front_segs, std::vector<Seg> &back_segs) {
-    splitter_ = Splitter(segs[splitter_index]);
+template <typename Predicate>
+void Node::choose_splitter(const std::vector<unsigned int> &segs, const SegBuffer &buffer, Context &context, Effort &effort, int &best_score, unsigned int &splitter) const {
+    std::vector<std::pair<int, unsigned int>> ranked;
+    rank_splitters<Predicate>(context.seg_pool, segs, buffer, context.pool, context.options.heuristic, context.options.beam_width, effort, ranked);
+
+    // A leaf
+    if (ranked.empty()) {
+        best_score = INT_MAX;
+        splitter   = 0;
+        return;
+    }
+
+    // Fall back on the best scoring splitter, which is what would've been chosen without looking ahead
+    best_score = ranked[0].first;
+    splitter   = ranked[0].second;
+
+    if (ranked.size() == 1)
+        return;
+
+    std::vector<Metric> metrics(ranked.size());
 
-    for (auto i = 0; i < segs.size(); i++) {
-        if (i == splitter_index) {
-            front_segs.push_back(segs[i]);
+    auto look = [&](std::size_t begin, std::size_t end, std::size_t) {
+        for (auto i = begin; i < end; i++)
+            metrics[i] = look_ahead<Predicate>(segs, ranked[i].second, context);
+    };
+
+    if (context.pool)
+        context.pool->parallel_for(ranked.size(), ranked.size(), look);
+    else
+        look(0, ranked.size(), 0);
+
+    // They can only be compared if they all finished before the deadline
+    for (const auto &metric : metrics) {
+        if (!metric.complete)
+            return;
+    }
+
+    // The smallest lumps win, then the shallowest tree, then the best score
+    std::size_t best = 0;
+
+    for (std::size_t i = 1; i < metrics.size(); i++) {
+        if (metrics[i].bytes < metrics[best].bytes || (metrics[i].bytes == metrics[best].bytes && metrics[i].depth < metrics[best].depth))
+            best = i;
+    }
+
+    best_score = ranked[best].first;
+    splitter   = ranked[best].second;
+}
+
+template <typename Predicate>
+void Node::rank_splitters(const SegPool &seg_pool, const std::vector<unsigned int> &segs, const SegBuffer &buffer, ThreadPool *pool, Heuristic heuristic, std::size_t count, Effort &effort, std::vector<std::pair<int, unsigned int>> &ranked) const {
+    std::vector<unsigned int> candidates;
+    Sweeps sweeps;
+    gather_splitters<Predicate>(seg_pool, segs, candidates, sweeps);
+
+    ranked.clear();
+
+    // Same as find_splitter(), but without stopping early, since more than the best are kept
+    std::vector<int> scores;
+
+    for (auto &[dir, sweep] : sweeps) {
+        if (sweep.size() < sweep_threshold) {
+            candidates.insert(candidates.end(), sweep.begin(), sweep.end());
             continue;
         }
 
-        int side = splitter_.side_of(segs[i]);
+        sweep_scores(seg_pool, segs, heuristic, dir.first, dir.second, sweep, scores);
 
-        if (side == -1)
-            front_segs.push_back(segs[i]);
-        else if (side == 1)
-            back_segs.push_back(segs[i]);
-        else {
-            auto new_lines = splitter_.cut(segs[i]);
-            front_segs.push_back(Seg(new_lines.first));
-            back_segs .push_back(Seg(new_lines.second));
+        effort.candidates += sweep.size();
+        effort.classified += segs.size() * 2;
+
+        for (std::size_t i = 0; i < sweep.size(); i++)
+            ranked.emplace_back(scores[i], sweep[i]);
+    }
+
+    scores.resize(candidates.size());
+
+    std::size_t chunks = pool && candidates.size() >= parallel_scoring_threshold ? pool->size() * 4 : 1;
+    std::vector<std::uint64_t> classified(chunks, 0);
+
+    auto score = [&](std::size_t begin, std::size_t end, std::size_t chunk) {
+        for (auto i = begin; i < end; i++)
+            scores[i] = splitter_score<Predicate>(seg_pool, segs, buffer, heuristic, candidates[i], classified[chunk]);
+    };
+
+    if (chunks > 1)
+        pool->parallel_for(candidates.size(), chunks, score);
+    else
+        score(0, candidates.size(), 0);
+
+    effort.candidates += candidates.size();
+    for (auto count : classified)
+        effort.classified += count;
+
+    for (std::size_t i = 0; i < candidates.size(); i++)
+        ranked.emplace_back(scores[i], candidates[i]);
+
+    // Splitters that leave a side empty don't split the node at all
+    ranked.erase(std::remove_if(ranked.begin(), ranked.end(), [](const auto &r) { return r.first == INT_MAX; }), ranked.end());
+
+    // The lowest score wins, with the lowest index breaking any ties
+    count = std::min(count, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end());
+    ranked.resize(count);
+}
+
+template <typename Predicate>
+Node::Metric Node::look_ahead(const std::vector<unsigned int> &segs, unsigned int splitter_index, const Context &context) {
+    SegPool seg_pool;
+    NodePool nodes;
+    LeafSegPool leaf_segs;
+
+    // Build greedily, on this thread, and stop at the same deadline as everything else
+    Context lookahead(seg_pool, nodes, leaf_segs, nullptr, nullptr, context.options);
+    lookahead.deadline  = context.deadline;
+    lookahead.lookahead = true;
+
+    std::vector<unsigned int> front, back;
+    for (auto index : segs)
+        front.push_back(seg_pool.add(context.seg_pool[index]));
+
+    SegBuffer buffer;
+    buffer.assign(seg_pool, front);
+
+    Node root;
+    root.split<Predicate>(seg_pool, front, buffer, splitter_index, back);
+
+    auto children = nodes.allocate(2);
+    NullObserver observer;
+
+    build_tree<Predicate>(children,     std::move(front), Polyf(), lookahead, observer);
+    build_tree<Predicate>(children + 1, std::move(back),  Polyf(), lookahead, observer);
+
+    Metric metric;
+    metric.complete = std::chrono::steady_clock::now() < context.deadline;
+
+    if (!metric.complete)
+        return metric;
+
+    // Every node that isn't a leaf is a NODES entry, including the one that was split here
+    std::size_t num_segs     = lookahead.num_segs;
+    std::size_t num_ssectors = lookahead.num_ssectors;
+    std::size_t num_nodes    = lookahead.num_nodes - lookahead.num_ssectors + 1;
+
+    metric.bytes = num_segs * 12 + num_ssectors * 4 + num_nodes * 28;
+
+    // Find the deepest leaf
+    std::vector<std::pair<unsigned int, unsigned int>> stack = {{children, 1}, {children + 1, 1}};
+
+    while (!stack.empty()) {
+        auto [index, depth] = stack.back();
+        stack.pop_back();
+
+        metric.depth = std::max(metric.depth, depth);
+
+        if (!nodes[index].leaf()) {
+            stack.emplace_back(nodes[index].left (), depth + 1);
+            stack.emplace_back(nodes[index].right(), depth + 1);
         }
     }
+
+    return metric;
 }
 
-Polyf Node::carve(const std::vector<Seg> &segs, const Polyf &poly) {
-    Polyf carved = poly;
+std::pair<std::int64_t, std::int64_t> Node::direction(const Seg &seg) {
+    auto dx = static_cast<std::int64_t>(seg.dx());
+    auto dy = static_cast<std::int64_t>(seg.dy());
+    auto d  = std::gcd(dx, dy);
+
+    if (!d)
+        return {0, 0};
 
-    for (const auto &seg : segs) {
-        auto polys = Splitter(seg).cut(carved);
-        carved = polys.second;
+    return {dx / d, dy / d};
+}
+
+void Node::sweep_scores(const SegPool &seg_pool, const std::vector<unsigned int> &segs, Heuristic heuristic, std::int64_t dx, std::int64_t dy, std::vector<unsigned int> &sweep, std::vector<int> &scores) const {
+    // How far a point is across the splitters, which is their cross product divided by their length in lowest terms
+    // Points further across are always behind the splitter
+    auto position = [&](const Vec2f &p) {
+        return dx * static_cast<std::int64_t>(p.y) - dy * static_cast<std::int64_t>(p.x);
+    };
+
+    // Points closer than this to the position of a splitter are on it
+    const std::int64_t band = Seg::band_of(dx, dy);
+
+    std::sort(sweep.begin(), sweep.end(), [&](unsigned int a, unsigned int b) {
+        auto pa = position(seg_pool[segs[a]].p1());
+        auto pb = position(seg_pool[segs[b]].p1());
+        return pa < pb || (pa == pb && a < b);
+    });
+
+    std::vector<std::int64_t> positions(sweep.size());
+    for (std::size_t i = 0; i < sweep.size(); i++)
+        positions[i] = position(seg_pool[segs[sweep[i]]].p1());
+
+    // Changes in the number of front, back, and split segs from one splitter to the next
+    std::vector<int> fronts(sweep.size() + 1, 0);
+    std::vector<int> backs (sweep.size() + 1, 0);
+    std::vector<int> splits(sweep.size() + 1, 0);
+
+    for (auto index : segs) {
+        const auto &seg = seg_pool[index];
+
+        // A point is behind every splitter before the first index, and in front of every splitter from the second onwards
+        auto find_sides = [&](const Vec2f &p, std::size_t &behind, std::size_t &in_front) {
+            auto pos = position(p);
+            behind   = std::partition_point(positions.begin(), positions.end(), [&](std::int64_t x) { return pos >= x + band; }) - positions.begin();
+            in_front = std::partition_point(positions.begin(), positions.end(), [&](std::int64_t x) { return pos >  x - band; }) - positions.begin();
+        };
+
+        std::size_t behind1, in_front1, behind2, in_front2;
+        find_sides(seg.p1(), behind1, in_front1);
+        find_sides(seg.p2(), behind2, in_front2);
+
+        // Same as Splitter::side_of(const Vec2f&)
+        auto point_side = [&](std::size_t i, std::size_t behind, std::size_t in_front) {
+            if (i < behind)
+                return 1;
+            if (i >= in_front)
+                return -1;
+
+            return 0;
+        };
+
+        // Segs that are collinear with a splitter go in front if they go the same way
+        int collinear_side = Common::sign(dx) == Common::sign(seg.dx()) && Common::sign(dy) == Common::sign(seg.dy()) ? -1 : 1;
+
+        std::size_t bounds[] = {0, behind1, in_front1, behind2, in_front2, sweep.size()};
+        std::sort(std::begin(bounds), std::end(bounds));
+
+        // The seg is on the same side of every splitter between two consecutive bounds
+        for (auto i = 0; i < 5; i++) {
+            auto begin = bounds[i];
+            auto end   = bounds[i + 1];
+
+            if (begin == end)
+                continue;
+
+            // Same as Splitter::side_of(const Seg&)
+            int s1 = point_side(begin, behind1, in_front1);
+            int s2 = point_side(begin, behind2, in_front2);
+            int side;
+
+            if (s1 == s2)
+                side = s1 ? s1 : collinear_side;
+            else if (!s1 || !s2)
+                side = s1 ? s1 : s2;
+            else
+                side = 0;
+
+            if (side <= 0) {
+                fronts[begin]++;
+                fronts[end]--;
+            }
+            if (side >= 0) {
+                backs[begin]++;
+                backs[end]--;
+            }
+            if (!side) {
+                splits[begin]++;
+                splits[end]--;
+            }
+        }
+    }
+
+    // Add up the changes to get the score of each splitter
+    scores.resize(sweep.size());
+
+    int front_count = 0;
+    int back_count  = 0;
+    int new_lines   = 0;
+
+    for (std::size_t i = 0; i < sweep.size(); i++) {
+        front_count += fronts[i];
+        back_count  += backs[i];
+        new_lines   += splits[i];
+
+        scores[i] = score(heuristic, front_share(heuristic, Splitter(seg_pool[segs[sweep[i]]])), front_count, back_count, new_lines);
+    }
+}
+
+template <typename Predicate>
+int Node::splitter_score(const SegPool &seg_pool, const std::vector<unsigned int> &segs, const SegBuffer &buffer, Heuristic heuristic, unsigned int splitter_index, std::uint64_t &classified, int bound) const {
+    Splitter splitter(seg_pool[segs[splitter_index]]);
+    int share = front_share(heuristic, splitter);
+
+    int front_count = 0;
+    int back_count  = 0;
+    int new_lines   = 0;
+
+    // Vertices are shared between segs, so each one is only classified once
+    static thread_local SegBuffer::VertexSides vertex_sides;
+    vertex_sides.reset();
+
+    for (std::size_t block = 0; block < buffer.blocks(); block++) {
+        // The splitter always goes in front of itself
+        auto counts = buffer.count<Predicate>(splitter, block, splitter_index, vertex_sides);
+
+        front_count += counts.front + counts.split;
+        back_count  += counts.back + counts.split;
+        new_lines   += counts.split;
+
+        int remaining = segs.size() - std::min(segs.size(), (block + 1) * SegBuffer::block_size);
+        int lowest    = score(heuristic, share, front_count, back_count, new_lines, remaining);
+
+        if (lowest > bound) {
+            classified += vertex_sides.classified;
+            return lowest;
+        }
+    }
+
+    classified += vertex_sides.classified;
+    return score(heuristic, share, front_count, back_count, new_lines);
+}
+
+int Node::front_share(Heuristic heuristic, const Splitter &splitter) const {
+    if (heuristic != Heuristic::Cost)
+        return share_scale / 2;
+
+    auto area = [](const Polyf &poly) {
+        double sum = 0;
+        for (std::size_t i = 0; i < poly.size(); i++)
+            sum += static_cast<double>(poly[i].x) * poly.at(i + 1).y - static_cast<double>(poly.at(i + 1).x) * poly[i].y;
+
+        return std::abs(sum) / 2;
+    };
+
+    // A line of segs has no area, so either side is as likely as the other
+    double total = static_cast<double>(bounds_.width()) * bounds_.height();
+    if (total <= 0)
+        return share_scale / 2;
+
+    Polyf box;
+    box.add(bounds_.top_left ());
+    box.add(bounds_.top_right());
+    box.add(bounds_.bot_right());
+    box.add(bounds_.bot_left ());
+
+    static thread_local Polyf scratch;
+    splitter.clip<ExactPredicate>(box, -1, scratch);
+
+    return static_cast<int>(std::lround(area(box) / total * share_scale));
+}
+
+int Node::score(Heuristic heuristic, int front_share, int front_count, int back_count, int new_lines, int remaining) {
+    // No lines intersect
+    if (!remaining && (!front_count || !back_count))
+        return INT_MAX;
+
+    std::int64_t score;
+
+    if (heuristic == Heuristic::Cost) {
+        // Like a surface area heuristic, the cost of each side is its seg count times the chance of walking into it
+        // A point is equally likely to be anywhere in the node, and split segs cost a visit to both sides
+        // Each of the remaining segs adds at least the share of the smaller side
+        int back_share = share_scale - front_share;
+        score = static_cast<std::int64_t>(front_share) * front_count + static_cast<std::int64_t>(back_share) * back_count
+              + static_cast<std::int64_t>(std::min(front_share, back_share)) * remaining;
+    }
+    else {
+        // Each of the remaining segs can only close the difference between the sides by one
+        score = std::max(std::abs(front_count - back_count) - remaining, 0) + new_lines*8;
     }
 
+    return static_cast<int>(std::min<std::int64_t>(score, INT_MAX - 1));
+}
+
+template <typename Predicate>
+std::size_t Node::split(SegPool &seg_pool, std::vector<unsigned int> &segs, const SegBuffer &buffer, unsigned int splitter_index, std::vector<unsigned int> &back_segs) {
+    splitter_ = Splitter(seg_pool[segs[splitter_index]]);
+    return split_segs<Predicate>(splitter_, seg_pool, segs, buffer, splitter_index, back_segs);
+}
+
+template <typename Predicate>
+std::size_t Node::split_segs(const Splitter &splitter, SegPool &seg_pool, std::vector<unsigned int> &segs, const SegBuffer &buffer, std::size_t front_seg, std::vector<unsigned int> &back_segs) {
+    // The front segs get packed into the start of the list as we go, which never overtakes the segs still to be read
+    std::size_t front_count = 0;
+    std::size_t cuts        = 0;
+
+    for (std::size_t block = 0; block < buffer.blocks(); block++) {
+        auto sides = buffer.classify<Predicate>(splitter, block);
+        auto start = block * SegBuffer::block_size;
+        auto end   = std::min(segs.size(), start + SegBuffer::block_size);
+
+        for (auto i = start; i < end; i++) {
+            auto bit = std::uint64_t(1) << (i - start);
+
+            if (i == front_seg || (sides.front & bit))
+                segs[front_count++] = segs[i];
+            else if (sides.back & bit)
+                back_segs.push_back(segs[i]);
+            else {
+                // Only this node has the seg, so the front half can replace it
+                auto new_lines = splitter.cut<Predicate>(seg_pool[segs[i]]);
+                seg_pool[segs[i]] = new_lines.first;
+
+                segs[front_count++] = segs[i];
+                back_segs.push_back(seg_pool.add(new_lines.second));
+                cuts++;
+            }
+        }
+    }
+
+    segs.resize(front_count);
+
+    return cuts;
+}
+
+template <typename Predicate>
+Polyf Node::carve(const SegPool &seg_pool, const std::vector<unsigned int> &segs, const Polyf &poly) {
+    static thread_local Polyf scratch;
+    Polyf carved = poly;
+
+    // Only the inside of each seg is kept, so there's no need to build the other side
+    for (auto index : segs)
+        Splitter(seg_pool[index]).clip<Predicate>(carved, -1, scratch);
+
     return carved;
 }
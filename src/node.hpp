@@ -18,36 +18,250 @@
 #include "splitter.hpp"
 #include "box.hpp"
 #include "seg.hpp"
+#include "seg_buffer.hpp"
+#include "seg_pool.hpp"
+#include "pool.hpp"
 #include "polygon.hpp"
+#include "thread_pool.hpp"
+#include "build_observer.hpp"
 #include <vector>
+#include <utility>
+#include <atomic>
+#include <climits>
+#include <chrono>
+#include <map>
 
-class Renderer;
+class Node;
+
+// Every node in a tree, which refer to their children by index
+using NodePool = Pool<Node, 12>;
+
+// How splitters get scored, where the lowest score wins
+enum class Heuristic {
+    Balance, // The original, which keeps both sides the same size and avoids splitting segs
+    Cost     // The expected cost of walking the tree, weighting each side by how much of the node's area it covers
+};
+
+// Settings that change the tree that gets built
+struct BuildOptions {
+    bool exact = true;                        // Use ExactPredicate, otherwise FloatPredicate
+    Heuristic heuristic = Heuristic::Balance;
+
+    // Time to spend per map looking ahead for a smaller tree, where none only ever takes the best scoring splitter
+    std::chrono::milliseconds quality_budget{0};
+    unsigned int beam_width = 4; // How many of the best scoring splitters are compared by building their sub-trees
+    unsigned int beam_depth = 6; // How many levels from the root are looked ahead from
+
+    // Only score one seg of each line going each way, which gives the same tree as scoring them all
+    bool collinear_groups = true;
+};
+
+// The segs of every leaf in a tree, with each leaf's being consecutive
+using LeafSegPool = Pool<unsigned int, 14>;
 
 class Node
 {
 public:
+    // State shared by every node while building a tree
+    struct Context {
+        Context(SegPool &seg_pool, NodePool &nodes, LeafSegPool &leaf_segs, ThreadPool *pool, BuildObserver *observer = nullptr, const BuildOptions &options = {}) :
+            seg_pool(seg_pool), nodes(nodes), leaf_segs(leaf_segs), pool(pool), observer(observer), options(options),
+            deadline(std::chrono::steady_clock::now() + options.quality_budget), lookahead(false), num_nodes(0), num_segs(0), num_ssectors(0),
+            num_candidates(0), num_classified(0), num_cuts(0) {
+        }
+
+        SegPool &seg_pool;       // Every seg in the tree, which nodes refer to by index
+        NodePool &nodes;         // Where the children of each node are added
+        LeafSegPool &leaf_segs;  // Where the segs of each leaf are stored
+        ThreadPool *pool;        // Optional, for building sub-trees in parallel
+        BuildObserver *observer; // Optional, for following the progress of the build
+        BuildOptions options;
+
+        std::chrono::steady_clock::time_point deadline; // When to stop looking ahead
+        bool lookahead;                                 // Whether this is a sub-tree being looked ahead at, which is abandoned at the deadline
+
+        std::atomic<int> num_nodes;
+        std::atomic<int> num_segs;
+        std::atomic<int> num_ssectors;
+
+        // How much work went into building the tree
+        std::atomic<std::uint64_t> num_candidates; // Splitters that were scored
+        std::atomic<std::uint64_t> num_classified; // Points that were classified against a splitter, which depends on scheduling with a thread pool
+        std::atomic<std::uint64_t> num_cuts;       // Segs that were cut in two
+    };
+
     Node();
-    Node(const std::vector<Seg> &segs, const Polyf &poly, Renderer &renderer, int &num_nodes, int &num_segs, int &num_ssectors);
-    ~Node();
 
-    void create(const std::vector<Seg> &segs, const Polyf &poly, Renderer &renderer, int &num_nodes, int &num_segs, int &num_ssectors);
+    /**
+     * Builds a node and the whole tree under it, without recursing
+     * @param index The index of the node in the pool
+     * @param segs The indices of the node's segs in the seg pool
+     * @param poly The area covered by the node, which is only used by observers
+     * @param context The tree that the node belongs to
+     */
+    static void create(unsigned int index, std::vector<unsigned int> segs, const Polyf &poly, Context &context);
+
+    /**
+     * Builds a tree again after some of its segs have changed, reusing every sub-tree that none of the changes reach
+     * Nodes above the changes keep their splitters, unless enough of their segs have changed to be worth building again
+     * @param index The root of the old tree, which is left as it is
+     * @param kept The segs that are the same as in the old tree
+     * @param added The segs that are new
+     * @param removed Copies of the segs that were in the old tree but are now gone
+     * @param context The tree being rebuilt, which the new nodes get added to
+     * @return The index of the new root
+     */
+    static unsigned int rebuild(unsigned int index, std::vector<unsigned int> kept, std::vector<unsigned int> added, std::vector<unsigned int> removed, Context &context);
 
-    const Node *left () const { return left_; }
-    const Node *right() const { return right_; }
-    const std::vector<Seg> segs() const { return segs_; }
+    /**
+     * Moves a tree to the start of the pools, dropping everything that isn't in it, such as the parts of older trees that a rebuild replaced
+     * Segs keep the order they were in, so that rebuilding from the tree gives the same nodes as before
+     * @param index The root of the tree
+     * @param seg_pool The segs of the tree
+     * @param nodes The nodes of the tree
+     * @param leaf_segs The segs of each leaf of the tree
+     * @return The index of the root, once it's been moved
+     */
+    static unsigned int compact(unsigned int index, SegPool &seg_pool, NodePool &nodes, LeafSegPool &leaf_segs);
+
+    // Indices into the node pool
+    unsigned int left () const { return left_; }
+    unsigned int right() const { return right_; }
+
+    // If this is a leaf node, the range of its segs in the leaf seg pool
+    unsigned int first_seg() const { return first_seg_; }
+    unsigned int num_segs () const { return num_segs_; }
 
     Splitter splitter() const { return splitter_; }
     Boxf bounds() const { return bounds_; }
-    bool leaf() const { return !segs_.empty(); }
+    bool leaf() const { return num_segs_ != 0; }
 
 private:
-    int splitter_score(const std::vector<Seg> &segs, unsigned int splitter_index) const;
-    void split(const std::vector<Seg> &segs, unsigned int splitter_index, std::vector<Seg> &front_segs, std::vector<Seg> &back_segs);
-    Polyf carve(const std::vector<Seg> &segs, const Polyf &poly);
+    // A node that still needs to be built
+    struct Work {
+        unsigned int node;
+        std::vector<unsigned int> segs;
+        Polyf poly; // Empty unless there's an observer
+        unsigned int depth = 0;
+    };
+
+    // A node of the old tree that's reached by changes, with its segs split the same way as before
+    struct Rebuild {
+        unsigned int old_node;
+        unsigned int node;
+        std::vector<unsigned int> kept, added, removed;
+
+        bool changed() const { return !added.empty() || !removed.empty(); }
+    };
+
+    template <typename Predicate>
+    static unsigned int rebuild_tree(Rebuild root, Context &context);
+
+    // How much a sub-tree adds to the lumps, for comparing splitters while looking ahead
+    struct Metric {
+        std::size_t bytes  = 0; // The size of its entries in SEGS, SSECTORS, and NODES
+        unsigned int depth = 0;
+        bool complete = false;  // False if it was abandoned at the deadline
+    };
+
+    // The work done for one node, which gets added to the context all at once
+    struct Effort {
+        std::uint64_t candidates = 0;
+        std::uint64_t classified = 0;
+        std::uint64_t cuts       = 0;
+    };
+
+    // Splitters that can be swept, by direction
+    using Sweeps = std::map<std::pair<std::int64_t, std::int64_t>, std::vector<unsigned int>>;
+
+    // Everything that classifies segs uses the same predicate, so the whole tree gets built with it
+    // Without an observer, a NullObserver is used so that none of the progress reporting gets compiled in
+    template <typename Predicate, typename Observer>
+    static void build_tree(unsigned int index, std::vector<unsigned int> segs, const Polyf &poly, Context &context, Observer &observer);
+
+    // Builds nodes until the stack is empty, handing large sub-trees to other threads in the group
+    template <typename Predicate, typename Observer>
+    static void build(std::vector<Work> &stack, Context &context, Observer &observer, ThreadPool::Group &group);
+
+    // Either makes this a leaf, returning false, or splits its segs between two new children
+    template <typename Predicate, typename Observer>
+    bool partition(Work &work, Context &context, Observer &observer, Work &front, Work &back);
+
+    // Sorts the splitters into those that can be swept and those that have to be scored one at a time
+    template <typename Predicate>
+    static void gather_splitters(const SegPool &seg_pool, const std::vector<unsigned int> &segs, std::vector<unsigned int> &candidates, Sweeps &sweeps);
+
+    template <typename Predicate>
+    void find_splitter(const SegPool &seg_pool, const std::vector<unsigned int> &segs, const SegBuffer &buffer, ThreadPool *pool, Heuristic heuristic, Effort &effort, int &best_score, unsigned int &splitter) const;
+
+    // Whether to look ahead from this node, instead of taking the best scoring splitter
+    static bool looks_ahead(const Work &work, const Context &context);
+
+    // Looks ahead from the best scoring splitters, choosing the one with the smallest sub-tree
+    template <typename Predicate>
+    void choose_splitter(const std::vector<unsigned int> &segs, const SegBuffer &buffer, Context &context, Effort &effort, int &best_score, unsigned int &splitter) const;
+
+    // Scores every splitter, keeping the best "count" of those that split the node, in order
+    template <typename Predicate>
+    void rank_splitters(const SegPool &seg_pool, const std::vector<unsigned int> &segs, const SegBuffer &buffer, ThreadPool *pool, Heuristic heuristic, std::size_t count, Effort &effort, std::vector<std::pair<int, unsigned int>> &ranked) const;
+
+    // Builds the sub-tree of a splitter on the current thread, from copies of the segs, to see how large it gets
+    template <typename Predicate>
+    static Metric look_ahead(const std::vector<unsigned int> &segs, unsigned int splitter_index, const Context &context);
+
+    // Finds the direction of a seg in its lowest terms, so that parallel segs going the same way match
+    static std::pair<std::int64_t, std::int64_t> direction(const Seg &seg);
+
+    // Scores parallel splitters that all go in the same direction in one pass, sorting them by position
+    // This matches splitter_score() when the predicate is exact, or for axis-aligned splitters with FloatPredicate
+    void sweep_scores(const SegPool &seg_pool, const std::vector<unsigned int> &segs, Heuristic heuristic, std::int64_t dx, std::int64_t dy, std::vector<unsigned int> &sweep, std::vector<int> &scores) const;
+
+    // Stops early, returning a score above the bound, once the splitter can no longer score within it
+    // Adds the number of points that had to be classified to "classified"
+    template <typename Predicate>
+    int splitter_score(const SegPool &seg_pool, const std::vector<unsigned int> &segs, const SegBuffer &buffer, Heuristic heuristic, unsigned int splitter_index, std::uint64_t &classified, int bound = INT_MAX) const;
+
+    // How much of the node's bounds are in front of a splitter, out of share_scale, for Heuristic::Cost
+    int front_share(Heuristic heuristic, const Splitter &splitter) const;
+
+    /**
+     * Scores a splitter from the segs that end up on each side of it
+     * @param front_share From front_share()
+     * @param remaining How many segs are still to be counted, giving the lowest score the splitter could still get
+     * @return The score, which is INT_MAX if a side is empty once every seg is counted
+     */
+    static int score(Heuristic heuristic, int front_share, int front_count, int back_count, int new_lines, int remaining = 0);
+
+    // Leaves the front segs in "segs", cutting any segs that cross the splitter and adding the back halves to the pool
+    // Returns the number of segs that were cut
+    template <typename Predicate>
+    std::size_t split(SegPool &seg_pool, std::vector<unsigned int> &segs, const SegBuffer &buffer, unsigned int splitter_index, std::vector<unsigned int> &back_segs);
+
+    // Same as split(), but with any splitter, where the seg at "front_seg" always goes in front if there is one
+    template <typename Predicate>
+    static std::size_t split_segs(const Splitter &splitter, SegPool &seg_pool, std::vector<unsigned int> &segs, const SegBuffer &buffer, std::size_t front_seg, std::vector<unsigned int> &back_segs);
+
+    template <typename Predicate>
+    Polyf carve(const SegPool &seg_pool, const std::vector<unsigned int> &segs, const Polyf &poly);
+
+    // Sub-trees with fewer segs than this are built on the current thread
+    static constexpr std::size_t parallel_threshold = 256;
+
+    // Nodes with at least this many segs score their splitters in parallel
+    static constexpr std::size_t parallel_scoring_threshold = 1024;
+
+    // Directions with fewer splitters than this are cheaper to score one at a time
+    static constexpr std::size_t sweep_threshold = 8;
+
+    // Nodes are built from scratch when more than one in this many of their segs have changed
+    static constexpr std::size_t rebuild_ratio = 4;
+
+    // Area shares are kept as integers, so that the cost of a splitter is the same however its segs get counted
+    static constexpr int share_scale = 1024;
 
-    Node *left_, *right_;
+    unsigned int left_, right_;
+    unsigned int first_seg_, num_segs_;
 
     Splitter splitter_;
     Boxf bounds_;
-    std::vector<Seg> segs_; // If this is a leaf node
 };
@@ -18,37 +18,63 @@
 #include "vec.hpp"
 #include "box.hpp"
 #include <vector>
+#include <cstddef>
 
-template <typename T>
+// Most polygons only have a few points, so they're stored inline until there's more than N of them
+template <typename T, std::size_t N = 16>
 class Poly
 {
 public:
+    Poly() : size_(0) {
+    }
+
     void add(const Vec2<T> &p) {
-        points_.push_back(p);
+        if (size_ < N)
+            inline_[size_] = p;
+        else {
+            // Move everything to the heap once it no longer fits
+            if (size_ == N)
+                heap_.assign(inline_, inline_ + N);
+
+            heap_.push_back(p);
+        }
+
+        size_++;
     }
 
+    void clear() {
+        size_ = 0;
+        heap_.clear();
+    }
+
+    // Wraps around past the last point
     Vec2<T> at(std::size_t i) const {
-        return points_.at(i % size());
+        return data()[i % size()];
     }
 
     Vec2<T> &at(std::size_t i) {
-        return points_.at(i % size());
+        return data()[i % size()];
     }
 
     std::size_t size() const {
-        return points_.size();
+        return size_;
+    }
+
+    const Vec2<T> *data() const {
+        return size_ > N ? heap_.data() : inline_;
     }
 
-    std::vector<Vec2<T>> &points() {
-        return points_;
+    Vec2<T> *data() {
+        return size_ > N ? heap_.data() : inline_;
     }
 
+    // Unlike at(), these don't wrap around
     Vec2<T> operator [] (std::size_t i) const {
-        return at(i);
+        return data()[i];
     }
 
     Vec2<T> &operator [] (std::size_t i) {
-        return at(i);
+        return data()[i];
     }
 
     bool point_inside(const Vec2<T> &p) const {
@@ -71,16 +97,18 @@ public:
     }
 
     Box<T> bounds() const {
-        Box<T> bounds(points_[0], points_[0]);
+        Box<T> bounds(data()[0], data()[0]);
 
-        for (const auto &point : points_)
-            bounds.extend(point);
+        for (std::size_t i = 0; i < size_; i++)
+            bounds.extend(data()[i]);
 
         return bounds;
     }
 
 private:
-    std::vector<Vec2<T>> points_;
+    std::size_t size_;
+    Vec2<T> inline_[N];
+    std::vector<Vec2<T>> heap_; // Only used once there's more than N points
 };
 
 using Polyi = Poly<int>;
@@ -0,0 +1,107 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+// Storage that items can be added to from any thread, referred to by 32-bit indices
+// Items are kept in fixed size chunks, so they never move once they've been added, and freeing it is just freeing the chunks
+template <typename T, unsigned int chunk_bits>
+class Pool
+{
+public:
+    Pool() : chunks_(new std::atomic<T*>[max_chunks]), size_(0) {
+        for (unsigned int i = 0; i < max_chunks; i++)
+            chunks_[i] = nullptr;
+    }
+
+    ~Pool() {
+        for (unsigned int i = 0; i < max_chunks; i++)
+            delete[] chunks_[i].load();
+    }
+
+    Pool(const Pool&) = delete;
+    Pool &operator = (const Pool&) = delete;
+
+    /**
+     * Adds default items with consecutive indices to the pool
+     * @param count The number of items to add
+     * @return The index of the first new item
+     */
+    unsigned int allocate(unsigned int count) {
+        auto first = size_.fetch_add(count);
+        auto last  = first + count - 1;
+
+        if (static_cast<std::size_t>(first) + count > static_cast<std::size_t>(max_chunks) << chunk_bits)
+            throw std::runtime_error("Too many items for pool");
+
+        // Whoever gets to a chunk first allocates it
+        for (auto chunk = first >> chunk_bits; chunk <= (last >> chunk_bits); chunk++) {
+            if (chunks_[chunk].load(std::memory_order_acquire))
+                continue;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (!chunks_[chunk].load(std::memory_order_relaxed))
+                chunks_[chunk].store(new T[chunk_size], std::memory_order_release);
+        }
+
+        return first;
+    }
+
+    /**
+     * Adds an item to the pool
+     * @param item The item to add
+     * @return The index of the new item
+     */
+    unsigned int add(const T &item) {
+        auto index = allocate(1);
+        (*this)[index] = item;
+
+        return index;
+    }
+
+    T &operator [] (unsigned int index) {
+        return chunks_[index >> chunk_bits].load(std::memory_order_relaxed)[index & (chunk_size - 1)];
+    }
+
+    const T &operator [] (unsigned int index) const {
+        return chunks_[index >> chunk_bits].load(std::memory_order_relaxed)[index & (chunk_size - 1)];
+    }
+
+    std::size_t size() const { return size_; }
+
+    // Removes every item, keeping the chunks to be reused, which isn't safe while other threads are adding to the pool
+    void clear() {
+        // Items that get allocated again have to start out as defaults
+        for (std::size_t i = 0; i < size_; i++)
+            (*this)[i] = T();
+
+        size_ = 0;
+    }
+
+private:
+    static constexpr unsigned int chunk_size = 1 << chunk_bits;
+    static constexpr unsigned int max_chunks = 1 << 12;
+
+    // The table never has to grow, so it's safe to read while other threads are adding chunks
+    std::unique_ptr<std::atomic<T*>[]> chunks_;
+    std::atomic<unsigned int> size_;
+    std::mutex mutex_;
+};
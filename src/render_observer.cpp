@@ -0,0 +1,96 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "render_observer.hpp"
+#include "renderer.hpp"
+#include "map.hpp"
+#include <string>
+
+RenderObserver::RenderObserver(Renderer &renderer, const Map &map) : renderer_(renderer), map_(map) {
+}
+
+bool RenderObserver::running() {
+    return renderer_.running();
+}
+
+void RenderObserver::node_started(const std::vector<Linef> &segs, const Polyf &poly) {
+    renderer_.clear();
+    renderer_.draw_map();
+
+    for (const auto &seg : segs)
+        renderer_.draw_line(seg);
+
+    renderer_.draw_poly(poly);
+}
+
+void RenderObserver::node_split(const Splitter &splitter, int nodes, int segs, int ssectors) {
+    renderer_.draw_splitter(splitter);
+
+    // Draw some stats
+    renderer_.draw_text(
+        std::string("Building Nodes...") +
+        "\nNode    #: " + std::to_string(nodes) +
+        "\nSeg     #: " + std::to_string(segs) +
+        "\nSSector #: " + std::to_string(ssectors)
+    );
+
+    renderer_.show();
+}
+
+void RenderObserver::leaf_created(const Polyf &poly) {
+    renderer_.add_poly(poly, Color::random());
+}
+
+void RenderObserver::block_created(const Boxf &box, const std::vector<Linef> &lines, int count) {
+    // Every block is the same size, so the grid can be worked out from this one
+    const auto size = box.width();
+    unsigned int width  = (map_.size().x + size - 1) / size;
+    unsigned int height = (map_.size().y + size - 1) / size;
+
+    // Draw a grid representing the block map
+    renderer_.clear();
+    const Color grid_color(0x20, 0x20, 0x20);
+
+    // Draw the horizontal lines
+    Vec2f pos(map_.offset().x, map_.offset().y);
+    for (auto y = 0; y <= height; y++) {
+        renderer_.draw_line(Linef(pos, pos + Vec2f(map_.size().x, 0.0f)), grid_color);
+        pos.y += size;
+    }
+
+    // Draw the vertical lines
+    pos = Vec2f(map_.offset().x, map_.offset().y);
+    for (auto x = 0; x <= width; x++) {
+        renderer_.draw_line(Linef(pos, pos + Vec2f(0.0f, map_.size().y)), grid_color);
+        pos.x += size;
+    }
+
+    renderer_.draw_map_outline();
+
+    // Draw the lines that are inside the box
+    const auto color = Color::random();
+    for (const auto &line : lines)
+        renderer_.add_line(line, color);
+
+    renderer_.draw_box(box);
+
+    // Draw some stats
+    renderer_.draw_text(
+        std::string("Building Blockmap...") +
+        "\nBlocks processed: " + std::to_string(count)
+    );
+
+    renderer_.show(60.0f);
+}
@@ -0,0 +1,40 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "build_observer.hpp"
+
+class Renderer;
+class Map;
+
+// Animates the build with a renderer
+class RenderObserver : public BuildObserver
+{
+public:
+    RenderObserver(Renderer &renderer, const Map &map);
+
+    bool running() override;
+
+    void node_started(const std::vector<Linef> &segs, const Polyf &poly) override;
+    void node_split(const Splitter &splitter, int nodes, int segs, int ssectors) override;
+    void leaf_created(const Polyf &poly) override;
+
+    void block_created(const Boxf &box, const std::vector<Linef> &lines, int count) override;
+
+private:
+    Renderer &renderer_;
+    const Map &map_;
+};
@@ -19,14 +19,21 @@
 #include "line.hpp"
 #include "common.hpp"
 #include <cmath>
+#include <cstdint>
 
 class Seg
 {
 public:
-    Seg() : side_(false), offset_(0.0f), linedef_(0) {
+    // Group for segs that don't share their infinite line with any others
+    static constexpr unsigned int no_group = ~0u;
+
+    Seg() : dx_(0.0f), dy_(0.0f), band_(0), offset_(0.0f), linedef_(0), group_(no_group), angle_(0), side_(false) {
     }
 
-    Seg(const Vec2f &p1, const Vec2f &p2, bool side, float offset, unsigned int linedef) : line_(p1, p2), side_(side), offset_(offset), linedef_(linedef) {
+    Seg(const Vec2f &p1, const Vec2f &p2, bool side, float offset, unsigned int linedef, unsigned int group = no_group) :
+        line_(p1, p2), dx_(p2.x - p1.x), dy_(p2.y - p1.y), offset_(offset), linedef_(linedef), group_(group), side_(side) {
+        band_  = band_of(dx_, dy_);
+        angle_ = bam(dx_, dy_);
     }
 
     inline Vec2f p1() const { return line_.a; }
@@ -36,20 +43,53 @@ public:
     inline bool side() const { return side_; }
     inline float offset() const { return offset_; }
     inline unsigned int linedef() const { return linedef_; }
+    inline unsigned int group() const { return group_; }
+
+    // Direction from the first point to the second
+    inline float dx() const { return dx_; }
+    inline float dy() const { return dy_; }
+
+    // How far a point's cross product with this seg's direction can get from zero while still being on its line
+    inline std::int64_t band() const { return band_; }
 
     // Binary Angle Measurement
-    std::int16_t angle() const {
-        float dx = line_.b.x - line_.a.x;
-        float dy = line_.b.y - line_.a.y;
+    inline std::int16_t angle() const { return angle_; }
+
+    /**
+     * Finds the smallest cross product of a direction and a point, that puts the point at least a distance of 2 from the line
+     * @param dx The delta X of the line
+     * @param dy The delta Y of the line
+     * @return The smallest cross product that is off of the line
+     */
+    static std::int64_t band_of(std::int64_t dx, std::int64_t dy) {
+        // A point is closer than 2 when "cross^2 < 2^2 * length^2", so find the smallest whole cross product that isn't
+        std::int64_t limit = 4 * (dx*dx + dy*dy);
+        auto band = static_cast<std::int64_t>(std::sqrt(static_cast<double>(limit)));
+
+        // Correct any rounding in the square root
+        while (band * band < limit)
+            band++;
+        while (band > 0 && (band - 1) * (band - 1) >= limit)
+            band--;
+
+        return band;
+    }
 
+private:
+    static std::int16_t bam(float dx, float dy) {
         // degrees = radians * 180 / PI
         // (0x8000 = 180 BAM)
         return std::atan2(dy, dx) * 0x8000 / Common::PI;
     }
 
-private:
+    // Everything after the line is worked out from it once, as segs get classified and cut many times over
     Linef line_;
-    bool side_;     // Side/Direction
+    float dx_, dy_;
+    std::int64_t band_;
+
     float offset_;  // Offset along linedef to start of seg
     unsigned int linedef_;
+    unsigned int group_;    // Segs in the same group all lie on the same infinite line, going the same way
+    std::int16_t angle_;
+    bool side_;     // Side/Direction
 };
@@ -0,0 +1,506 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "seg_buffer.hpp"
+#include "common.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define NODEBUILDER_SSE2
+#include "seg_classify.hpp"
+#include <emmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+struct Sse2 {
+    using V = __m128;
+    static constexpr std::size_t width = 4;
+
+    static V set(float f) { return _mm_set1_ps(f); }
+    static V load(const float *p) { return _mm_loadu_ps(p); }
+
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+    static V lt(V a, V b) { return _mm_cmplt_ps(a, b); }
+    static V gt(V a, V b) { return _mm_cmpgt_ps(a, b); }
+    static V eq(V a, V b) { return _mm_cmpeq_ps(a, b); }
+
+    static V bit_and(V a, V b) { return _mm_and_ps(a, b); }
+    static V bit_or (V a, V b) { return _mm_or_ps(a, b); }
+    static V bit_andnot(V a, V b) { return _mm_andnot_ps(a, b); }
+    static V bit_not(V a) { return _mm_xor_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1))); }
+
+    static int mask(V a) { return _mm_movemask_ps(a); }
+};
+
+// Converts the coordinates to doubles as they're loaded
+struct Sse2Double {
+    using V = __m128d;
+    static constexpr std::size_t width = 2;
+
+    static V set(double d) { return _mm_set1_pd(d); }
+    static V load(const float *p) { return _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(p)))); }
+
+    static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+
+    static V lt(V a, V b) { return _mm_cmplt_pd(a, b); }
+    static V gt(V a, V b) { return _mm_cmpgt_pd(a, b); }
+    static V eq(V a, V b) { return _mm_cmpeq_pd(a, b); }
+
+    static V bit_and(V a, V b) { return _mm_and_pd(a, b); }
+    static V bit_or (V a, V b) { return _mm_or_pd(a, b); }
+    static V bit_andnot(V a, V b) { return _mm_andnot_pd(a, b); }
+    static V bit_not(V a) { return _mm_xor_pd(a, _mm_castsi128_pd(_mm_set1_epi32(-1))); }
+
+    static int mask(V a) { return _mm_movemask_pd(a); }
+};
+
+}
+#endif
+
+#ifdef NODEBUILDER_AVX2
+// Defined in seg_classify_avx2.cpp
+void classify_block_float_avx2(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                               float px, float py, float sdx, float sdy,
+                               std::uint64_t &front, std::uint64_t &back, std::uint64_t &split);
+void classify_block_exact_avx2(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                               float px, float py, float sdx, float sdy, std::int64_t band,
+                               std::uint64_t &front, std::uint64_t &back, std::uint64_t &split);
+void classify_points_float_avx2(const float *x, const float *y, std::size_t count,
+                                float px, float py, float sdx, float sdy,
+                                std::uint64_t &on, std::uint64_t &front);
+void classify_points_exact_avx2(const float *x, const float *y, std::size_t count,
+                                float px, float py, float sdx, float sdy, std::int64_t band,
+                                std::uint64_t &on, std::uint64_t &front);
+void combine_sides_avx2(const std::uint8_t *sides, const unsigned int *v1, const unsigned int *v2, const std::uint8_t *dirs, std::size_t count,
+                        std::uint8_t dir,
+                        std::uint64_t &front, std::uint64_t &back, std::uint64_t &split);
+
+static bool cpu_has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    // The OS also has to save the AVX registers
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    // This runs from a static initialiser, which can come before GCC's own one that fills in what the CPU supports
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+using FloatFunc = void (*)(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                           float px, float py, float sdx, float sdy,
+                           std::uint64_t &front, std::uint64_t &back, std::uint64_t &split);
+using ExactFunc = void (*)(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                           float px, float py, float sdx, float sdy, std::int64_t band,
+                           std::uint64_t &front, std::uint64_t &back, std::uint64_t &split);
+using FloatPointsFunc = void (*)(const float *x, const float *y, std::size_t count,
+                                 float px, float py, float sdx, float sdy,
+                                 std::uint64_t &on, std::uint64_t &front);
+using ExactPointsFunc = void (*)(const float *x, const float *y, std::size_t count,
+                                 float px, float py, float sdx, float sdy, std::int64_t band,
+                                 std::uint64_t &on, std::uint64_t &front);
+using CombineFunc = void (*)(const std::uint8_t *sides, const unsigned int *v1, const unsigned int *v2, const std::uint8_t *dirs, std::size_t count,
+                             std::uint8_t dir,
+                             std::uint64_t &front, std::uint64_t &back, std::uint64_t &split);
+
+// Used if there's no vector instructions available
+template <typename Predicate>
+static void classify_block_scalar(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                                  const Splitter &splitter,
+                                  std::uint64_t &front, std::uint64_t &back, std::uint64_t &split) {
+    front = back = split = 0;
+
+    for (std::size_t i = 0; i < count; i++) {
+        int side = splitter.side_of<Predicate>(Vec2f(x1[i], y1[i]), Vec2f(x2[i], y2[i]));
+
+        if (side == -1)
+            front |= std::uint64_t(1) << i;
+        else if (side == 1)
+            back |= std::uint64_t(1) << i;
+        else
+            split |= std::uint64_t(1) << i;
+    }
+}
+
+template <typename Predicate>
+static void classify_points_scalar(const float *x, const float *y, std::size_t count,
+                                   const Splitter &splitter,
+                                   std::uint64_t &on, std::uint64_t &front) {
+    on = front = 0;
+
+    for (std::size_t i = 0; i < count; i++) {
+        int side = splitter.side_of<Predicate>(Vec2f(x[i], y[i]));
+
+        if (side == -1)
+            front |= std::uint64_t(1) << i;
+        else if (!side)
+            on |= std::uint64_t(1) << i;
+    }
+}
+
+#ifdef NODEBUILDER_SSE2
+static void classify_block_float_sse2(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                                      float px, float py, float sdx, float sdy,
+                                      std::uint64_t &front, std::uint64_t &back, std::uint64_t &split) {
+    classify_block_float<Sse2>(x1, y1, x2, y2, count, px, py, sdx, sdy, front, back, split);
+}
+
+static void classify_block_exact_sse2(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                                      float px, float py, float sdx, float sdy, std::int64_t band,
+                                      std::uint64_t &front, std::uint64_t &back, std::uint64_t &split) {
+    classify_block_exact<Sse2Double>(x1, y1, x2, y2, count, px, py, sdx, sdy, band, front, back, split);
+}
+
+static void classify_points_float_sse2(const float *x, const float *y, std::size_t count,
+                                       float px, float py, float sdx, float sdy,
+                                       std::uint64_t &on, std::uint64_t &front) {
+    classify_points_float<Sse2>(x, y, count, px, py, sdx, sdy, on, front);
+}
+
+static void classify_points_exact_sse2(const float *x, const float *y, std::size_t count,
+                                       float px, float py, float sdx, float sdy, std::int64_t band,
+                                       std::uint64_t &on, std::uint64_t &front) {
+    classify_points_exact<Sse2Double>(x, y, count, px, py, sdx, sdy, band, on, front);
+}
+#endif
+
+// The vectorised classifiers, if any
+struct ClassifyImpl {
+    FloatFunc float_func;
+    ExactFunc exact_func;
+    FloatPointsFunc float_points;
+    ExactPointsFunc exact_points;
+    CombineFunc combine;
+    const char *name;
+};
+
+// Every instruction set that the CPU supports, best first
+static std::vector<ClassifyImpl> supported_impls() {
+    std::vector<ClassifyImpl> impls;
+
+#ifdef NODEBUILDER_AVX2
+    if (cpu_has_avx2())
+        impls.push_back(ClassifyImpl{classify_block_float_avx2, classify_block_exact_avx2, classify_points_float_avx2, classify_points_exact_avx2, combine_sides_avx2, "AVX2"});
+#endif
+#ifdef NODEBUILDER_SSE2
+    impls.push_back(ClassifyImpl{classify_block_float_sse2, classify_block_exact_sse2, classify_points_float_sse2, classify_points_exact_sse2, nullptr, "SSE2"});
+#endif
+    impls.push_back(ClassifyImpl{nullptr, nullptr, nullptr, nullptr, nullptr, "Scalar"});
+
+    return impls;
+}
+
+// Pick the best instruction set that the CPU supports
+static ClassifyImpl classify_impl = supported_impls().front();
+
+// The side of a point, as stored for each vertex
+enum PointSide : std::uint8_t {
+    point_back  = 0,
+    point_on    = 1,
+    point_front = 2
+};
+
+// Segs are counted in separate 16-bit fields of a single number, as there's never more than a block of them
+constexpr std::uint64_t count_front = 1;
+constexpr std::uint64_t count_back  = std::uint64_t(1) << 16;
+constexpr std::uint64_t count_split = std::uint64_t(1) << 32;
+
+// What to count a seg as, indexed by the side of each end and if it goes the same way as the splitter
+// This is the same as Splitter::side_of(const Vec2f&, const Vec2f&)
+static const auto seg_sides = []() {
+    std::array<std::uint64_t, 3 * 3 * 2> sides;
+
+    for (int s1 = 0; s1 < 3; s1++) {
+        for (int s2 = 0; s2 < 3; s2++) {
+            for (int same_way = 0; same_way < 2; same_way++) {
+                std::uint64_t side;
+
+                if (s1 == s2 && s1 == point_on)
+                    side = same_way ? count_front : count_back; // Collinear segs go in front if they go the same way
+                else if (s1 == s2 || s2 == point_on)
+                    side = s1 == point_front ? count_front : count_back;
+                else if (s1 == point_on)
+                    side = s2 == point_front ? count_front : count_back;
+                else
+                    side = count_split;
+
+                sides[(s1 * 3 + s2) * 2 + same_way] = side;
+            }
+        }
+    }
+
+    return sides;
+}();
+
+// Spreads each bit of a byte out into the lowest bit of a byte, for writing 8 point sides at once
+static const auto spread_bits = []() {
+    std::array<std::uint64_t, 256> spread;
+
+    for (int byte = 0; byte < 256; byte++) {
+        // Built from the bytes, so it doesn't depend on the byte order
+        std::uint8_t bytes[8];
+        for (int bit = 0; bit < 8; bit++)
+            bytes[bit] = (byte >> bit) & 1;
+
+        std::memcpy(&spread[byte], bytes, sizeof(bytes));
+    }
+
+    return spread;
+}();
+
+// Packs the signs of a direction into a single number, so that two directions go the same way if they match
+static std::uint8_t direction_signs(float dx, float dy) {
+    return (Common::sign(dx) + 1) * 3 + (Common::sign(dy) + 1);
+}
+
+void SegBuffer::assign(const SegPool &seg_pool, const std::vector<unsigned int> &segs) {
+    size_ = segs.size();
+
+    x1_.resize(blocks() * block_size);
+    y1_.resize(blocks() * block_size);
+    x2_.resize(blocks() * block_size);
+    y2_.resize(blocks() * block_size);
+
+    v1_.resize(blocks() * block_size);
+    v2_.resize(blocks() * block_size);
+    dirs_.resize(blocks() * block_size);
+    vertex_end_.resize(blocks());
+
+    // Clear the vertex table, keeping it at most half full
+    std::size_t capacity = 16;
+    while (capacity < size_ * 4)
+        capacity *= 2;
+
+    hash_ids_.assign(capacity, ~0u);
+    hash_keys_.resize(capacity);
+    vx_.clear();
+    vy_.clear();
+
+    for (std::size_t i = 0; i < segs.size(); i++) {
+        const auto &seg = seg_pool[segs[i]];
+
+        x1_[i] = seg.p1().x;
+        y1_[i] = seg.p1().y;
+        x2_[i] = seg.p2().x;
+        y2_[i] = seg.p2().y;
+
+        v1_[i] = add_vertex(seg.p1());
+        v2_[i] = add_vertex(seg.p2());
+        dirs_[i] = direction_signs(seg.dx(), seg.dy());
+
+        if (i % block_size == block_size - 1 || i == size_ - 1)
+            vertex_end_[i / block_size] = vx_.size();
+    }
+
+    vx_.resize((vx_.size() + block_size - 1) / block_size * block_size, 0.0f);
+    vy_.resize(vx_.size(), 0.0f);
+
+    // The padding uses the first vertex
+    std::fill(v1_.begin() + size_, v1_.end(), 0);
+    std::fill(v2_.begin() + size_, v2_.end(), 0);
+    std::fill(dirs_.begin() + size_, dirs_.end(), 0);
+
+    // Fill the padding with something harmless
+    std::fill(x1_.begin() + size_, x1_.end(), 0.0f);
+    std::fill(y1_.begin() + size_, y1_.end(), 0.0f);
+    std::fill(x2_.begin() + size_, x2_.end(), 0.0f);
+    std::fill(y2_.begin() + size_, y2_.end(), 0.0f);
+}
+
+template <>
+SegBuffer::Sides SegBuffer::classify<FloatPredicate>(const Splitter &splitter, std::size_t block) const {
+    auto start = block * block_size;
+    auto count = std::min(block_size, size_ - start);
+
+    Sides sides;
+
+    if (!classify_impl.float_func)
+        classify_block_scalar<FloatPredicate>(&x1_[start], &y1_[start], &x2_[start], &y2_[start], count, splitter, sides.front, sides.back, sides.split);
+    else {
+        classify_impl.float_func(
+            &x1_[start], &y1_[start], &x2_[start], &y2_[start], count,
+            splitter.p.x, splitter.p.y, splitter.dx, splitter.dy,
+            sides.front, sides.back, sides.split
+        );
+    }
+
+    return sides;
+}
+
+template <>
+SegBuffer::Sides SegBuffer::classify<ExactPredicate>(const Splitter &splitter, std::size_t block) const {
+    auto start = block * block_size;
+    auto count = std::min(block_size, size_ - start);
+
+    Sides sides;
+
+    if (!classify_impl.exact_func)
+        classify_block_scalar<ExactPredicate>(&x1_[start], &y1_[start], &x2_[start], &y2_[start], count, splitter, sides.front, sides.back, sides.split);
+    else {
+        classify_impl.exact_func(
+            &x1_[start], &y1_[start], &x2_[start], &y2_[start], count,
+            splitter.p.x, splitter.p.y, splitter.dx, splitter.dy, splitter.band,
+            sides.front, sides.back, sides.split
+        );
+    }
+
+    return sides;
+}
+
+template <typename Predicate>
+SegBuffer::Counts SegBuffer::count(const Splitter &splitter, std::size_t block, std::size_t front_seg, VertexSides &vertex_sides) const {
+    classify_vertices<Predicate>(splitter, vertex_end_[block], vertex_sides);
+
+    auto start = block * block_size;
+    auto end   = std::min(size_, start + block_size);
+    auto dir   = direction_signs(splitter.dx, splitter.dy);
+
+    const auto *sides = vertex_sides.sides.data();
+    auto seg_side = [&](std::size_t i) {
+        return seg_sides[(sides[v1_[i]] * 3 + sides[v2_[i]]) * 2 + (dirs_[i] == dir)];
+    };
+
+    std::uint64_t counts = 0;
+
+    if (!classify_impl.combine) {
+        for (auto i = start; i < end; i++)
+            counts += seg_side(i);
+    }
+    else {
+        std::uint64_t front, back, split;
+        classify_impl.combine(sides, &v1_[start], &v2_[start], &dirs_[start], end - start, dir, front, back, split);
+
+        counts = Common::popcount(front) * count_front + Common::popcount(back) * count_back + Common::popcount(split) * count_split;
+    }
+
+    if (front_seg >= start && front_seg < end)
+        counts += count_front - seg_side(front_seg);
+
+    return Counts{
+        static_cast<int>(counts & 0xffff),
+        static_cast<int>((counts >> 16) & 0xffff),
+        static_cast<int>((counts >> 32) & 0xffff)
+    };
+}
+
+template SegBuffer::Counts SegBuffer::count<FloatPredicate>(const Splitter &splitter, std::size_t block, std::size_t front_seg, VertexSides &vertex_sides) const;
+template SegBuffer::Counts SegBuffer::count<ExactPredicate>(const Splitter &splitter, std::size_t block, std::size_t front_seg, VertexSides &vertex_sides) const;
+
+unsigned int SegBuffer::add_vertex(const Vec2f &p) {
+    // Use the exact bits of the coordinates, so that only identical vertices are shared
+    std::uint32_t x, y;
+    std::memcpy(&x, &p.x, sizeof(x));
+    std::memcpy(&y, &p.y, sizeof(y));
+
+    std::uint64_t key = (static_cast<std::uint64_t>(x) << 32) | y;
+    std::size_t mask  = hash_ids_.size() - 1;
+
+    for (std::size_t slot = (key * 0x9e3779b97f4a7c15ull) >> 32 & mask;; slot = (slot + 1) & mask) {
+        if (hash_ids_[slot] == ~0u) {
+            hash_keys_[slot] = key;
+            hash_ids_[slot]  = vx_.size();
+
+            vx_.push_back(p.x);
+            vy_.push_back(p.y);
+
+            return hash_ids_[slot];
+        }
+
+        if (hash_keys_[slot] == key)
+            return hash_ids_[slot];
+    }
+}
+
+template <typename Predicate>
+void SegBuffer::classify_vertices(const Splitter &splitter, std::size_t count, VertexSides &vertex_sides) const {
+    auto &sides = vertex_sides.sides;
+
+    // Sides can be read 4 bytes at a time
+    if (sides.size() < vx_.size() + 3)
+        sides.resize(vx_.size() + 3);
+
+    // Whole blocks of vertices are classified at once, so they stay aligned with the padding
+    while (vertex_sides.classified < count) {
+        auto start = vertex_sides.classified;
+        auto num   = std::min(block_size, vx_.size() - start);
+
+        std::uint64_t on, front;
+
+        if constexpr (Predicate::exact) {
+            if (!classify_impl.exact_points)
+                classify_points_scalar<Predicate>(&vx_[start], &vy_[start], num, splitter, on, front);
+            else
+                classify_impl.exact_points(&vx_[start], &vy_[start], num, splitter.p.x, splitter.p.y, splitter.dx, splitter.dy, splitter.band, on, front);
+        }
+        else {
+            if (!classify_impl.float_points)
+                classify_points_scalar<Predicate>(&vx_[start], &vy_[start], num, splitter, on, front);
+            else
+                classify_impl.float_points(&vx_[start], &vy_[start], num, splitter.p.x, splitter.p.y, splitter.dx, splitter.dy, on, front);
+        }
+
+        // The vertices are padded to a whole number of blocks, so there's always 8 at a time
+        for (std::size_t i = 0; i < num; i += 8) {
+            std::uint64_t packed = spread_bits[(on >> i) & 0xff] * point_on + spread_bits[(front >> i) & 0xff] * point_front;
+            std::memcpy(&sides[start + i], &packed, sizeof(packed));
+        }
+
+        vertex_sides.classified += num;
+    }
+}
+
+const char *SegBuffer::instruction_set() {
+    return classify_impl.name;
+}
+
+std::vector<std::string> SegBuffer::instruction_sets() {
+    std::vector<std::string> names;
+    for (const auto &impl : supported_impls())
+        names.push_back(impl.name);
+
+    return names;
+}
+
+bool SegBuffer::use_instruction_set(const std::string &name) {
+    for (const auto &impl : supported_impls()) {
+        if (name == impl.name) {
+            classify_impl = impl;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,123 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "seg.hpp"
+#include "splitter.hpp"
+#include "seg_pool.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// The segs of a node stored as separate arrays, so they can be classified several at a time
+class SegBuffer
+{
+public:
+    // The number of segs classified at once
+    static constexpr std::size_t block_size = 64;
+
+    // Which side of a splitter each seg in a block is on, with one bit per seg
+    struct Sides {
+        std::uint64_t front; // Left
+        std::uint64_t back;  // Right
+        std::uint64_t split; // Intersects
+    };
+
+    // How many segs in a block are on each side of a splitter
+    struct Counts {
+        int front;
+        int back;
+        int split;
+    };
+
+    // The sides of the unique vertices for one splitter, which only get classified once a block needs them
+    struct VertexSides {
+        std::vector<std::uint8_t> sides;
+        std::size_t classified = 0;
+
+        // Must be called before counting with another splitter
+        void reset() { classified = 0; }
+    };
+
+    void assign(const SegPool &seg_pool, const std::vector<unsigned int> &segs);
+
+    std::size_t size() const { return size_; }
+    std::size_t blocks() const { return (size_ + block_size - 1) / block_size; }
+
+    /**
+     * Determines what side of a splitter each seg in a block is on, the same as Splitter::side_of<Predicate>(const Seg&)
+     * @param splitter The splitter to check against
+     * @param block The index of the block
+     * @return The sides of the segs in the block
+     */
+    template <typename Predicate>
+    Sides classify(const Splitter &splitter, std::size_t block) const;
+
+    /**
+     * Counts the segs in a block on each side of a splitter, the same as classify() but only classifying each unique vertex once
+     * @param splitter The splitter to check against
+     * @param block The index of the block
+     * @param front_seg A seg that always counts as being in front, such as the splitter's own seg
+     * @param vertex_sides The vertices classified by earlier blocks, for the same splitter
+     * @return The number of segs on each side
+     */
+    template <typename Predicate>
+    Counts count(const Splitter &splitter, std::size_t block, std::size_t front_seg, VertexSides &vertex_sides) const;
+
+    /**
+     * Gets the name of the instruction set used by classify()
+     * @return The name
+     */
+    static const char *instruction_set();
+
+    // The names of every instruction set that the CPU supports, best first, ending with "Scalar"
+    static std::vector<std::string> instruction_sets();
+
+    /**
+     * Changes the instruction set used by classify() and count(), which is only meant for testing as it isn't thread safe
+     * @param name The name of the instruction set, from instruction_sets()
+     * @return false if the CPU doesn't support it
+     */
+    static bool use_instruction_set(const std::string &name);
+
+private:
+    // Finds the index of a vertex, adding it if it's new
+    unsigned int add_vertex(const Vec2f &p);
+
+    template <typename Predicate>
+    void classify_vertices(const Splitter &splitter, std::size_t count, VertexSides &vertex_sides) const;
+
+    std::size_t size_ = 0;
+
+    // Padded to a whole number of blocks
+    std::vector<float> x1_, y1_, x2_, y2_;
+
+    // The unique vertices, in the order that the segs first use them, also padded to a whole number of blocks
+    std::vector<float> vx_, vy_;
+    std::vector<unsigned int> v1_, v2_; // The vertices of each seg
+    std::vector<std::uint8_t> dirs_;    // The signs of each seg's deltas, to check if collinear segs go the same way
+    std::vector<std::size_t> vertex_end_; // How many vertices the segs up to the end of each block use
+
+    // Open addressing table from a vertex to its index, which is rebuilt by every assign()
+    std::vector<std::uint64_t> hash_keys_;
+    std::vector<unsigned int> hash_ids_;
+};
+
+// Only these predicates have vectorised versions
+template <>
+SegBuffer::Sides SegBuffer::classify<FloatPredicate>(const Splitter &splitter, std::size_t block) const;
+template <>
+SegBuffer::Sides SegBuffer::classify<ExactPredicate>(const Splitter &splitter, std::size_t block) const;
@@ -0,0 +1,232 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Vectorised versions of Splitter::side_of(const Seg&), shared by each instruction set.
+// This is included by a separate source file for each instruction set, so it must only
+// use plain data and the intrinsics of the Simd type it's given, and everything here
+// must stay internal to the including file.
+
+#include <cstdint>
+#include <cstddef>
+
+namespace {
+
+// Classifies a block of up to 64 segs, with the arrays padded to a multiple of the vector width
+// The side of each end is found by "point_side(x, y, on, in_front)", and they're combined like Splitter::side_of(const Vec2f&, const Vec2f&)
+template <typename Simd, typename PointSide>
+inline void classify_segs(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                          float sdx, float sdy, PointSide point_side,
+                          std::uint64_t &front, std::uint64_t &back, std::uint64_t &split) {
+    using V = typename Simd::V;
+
+    const V zero = Simd::set(0.0f);
+
+    // Masks for the direction of the splitter, for checking if collinear segs go the same way
+    const int sign_x = (0.0f < sdx) - (sdx < 0.0f);
+    const int sign_y = (0.0f < sdy) - (sdy < 0.0f);
+
+    auto same_sign = [&](V v, int sign) {
+        if (sign > 0)
+            return Simd::gt(v, zero);
+        if (sign < 0)
+            return Simd::lt(v, zero);
+
+        return Simd::eq(v, zero);
+    };
+
+    front = back = split = 0;
+
+    for (std::size_t i = 0; i < count; i += Simd::width) {
+        V sx1 = Simd::load(x1 + i);
+        V sy1 = Simd::load(y1 + i);
+        V sx2 = Simd::load(x2 + i);
+        V sy2 = Simd::load(y2 + i);
+
+        V on1, front1, on2, front2;
+        point_side(sx1, sy1, on1, front1);
+        point_side(sx2, sy2, on2, front2);
+
+        V back1 = Simd::bit_not(Simd::bit_or(on1, front1));
+        V back2 = Simd::bit_not(Simd::bit_or(on2, front2));
+
+        // Collinear segs go in front if they point the same way as the splitter
+        V collinear = Simd::bit_and(on1, on2);
+        V same_way  = Simd::bit_and(same_sign(Simd::sub(sx2, sx1), sign_x), same_sign(Simd::sub(sy2, sy1), sign_y));
+
+        V f = Simd::bit_andnot(Simd::bit_andnot(same_way, collinear), Simd::bit_and(Simd::bit_or(front1, on1), Simd::bit_or(front2, on2)));
+        V b = Simd::bit_andnot(Simd::bit_and(same_way, collinear), Simd::bit_and(Simd::bit_or(back1, on1), Simd::bit_or(back2, on2)));
+        V s = Simd::bit_or(Simd::bit_and(front1, back2), Simd::bit_and(back1, front2));
+
+        front |= static_cast<std::uint64_t>(Simd::mask(f)) << i;
+        back  |= static_cast<std::uint64_t>(Simd::mask(b)) << i;
+        split |= static_cast<std::uint64_t>(Simd::mask(s)) << i;
+    }
+
+    // Ignore the padding
+    if (count < 64) {
+        std::uint64_t valid = (std::uint64_t(1) << count) - 1;
+        front &= valid;
+        back  &= valid;
+        split &= valid;
+    }
+}
+
+// Classifies a block of up to 64 points, with the arrays padded to a multiple of the vector width
+// Points that aren't on the splitter are behind it unless they're in front
+template <typename Simd, typename PointSide>
+inline void classify_points(const float *x, const float *y, std::size_t count, PointSide point_side,
+                            std::uint64_t &on, std::uint64_t &front) {
+    using V = typename Simd::V;
+
+    on = front = 0;
+
+    for (std::size_t i = 0; i < count; i += Simd::width) {
+        V o, f;
+        point_side(Simd::load(x + i), Simd::load(y + i), o, f);
+
+        on    |= static_cast<std::uint64_t>(Simd::mask(o)) << i;
+        front |= static_cast<std::uint64_t>(Simd::mask(f)) << i;
+    }
+
+    // Ignore the padding
+    if (count < 64) {
+        std::uint64_t valid = (std::uint64_t(1) << count) - 1;
+        on    &= valid;
+        front &= valid;
+    }
+}
+
+// Makes a test for if points are on a splitter, and if not whether they're in front, the same as FloatPredicate
+template <typename Simd>
+inline auto float_point_side(float px, float py, float sdx, float sdy) {
+    using V = typename Simd::V;
+
+    const V zero = Simd::set(0.0f);
+    const V vpx  = Simd::set(px);
+    const V vpy  = Simd::set(py);
+    const V vsdx = Simd::set(sdx);
+    const V vsdy = Simd::set(sdy);
+
+    // The constant parts of the distance test, done the same way as the scalar code
+    const float a = sdx*sdx + sdy*sdy;
+    const V va4   = Simd::set(4 * a);
+    const V two   = Simd::set(2.0f);
+    const V four  = Simd::set(2 * 2);
+    const V half  = Simd::set(0.5f);
+
+    const V lo_x = Simd::set(px - 2);
+    const V hi_x = Simd::set(px + 2);
+    const V lo_y = Simd::set(py - 2);
+    const V hi_y = Simd::set(py + 2);
+
+    return [=](V x, V y, V &on, V &in_front) {
+        if (!sdx) {
+            on = Simd::bit_and(Simd::gt(x, lo_x), Simd::lt(x, hi_x));
+            V less = Simd::lt(x, vpx);
+
+            if (sdy > 0)
+                in_front = Simd::bit_andnot(on, Simd::bit_not(less));
+            else if (sdy < 0)
+                in_front = Simd::bit_andnot(on, less);
+            else
+                in_front = Simd::bit_not(on);
+
+            return;
+        }
+        if (!sdy) {
+            on = Simd::bit_and(Simd::gt(y, lo_y), Simd::lt(y, hi_y));
+            V less = Simd::lt(y, vpy);
+
+            if (sdx > 0)
+                in_front = Simd::bit_andnot(on, less);
+            else
+                in_front = Simd::bit_andnot(on, Simd::bit_not(less));
+
+            return;
+        }
+
+        // Check if the point is within a distance of 2 from the splitter
+        V dx = Simd::sub(vpx, x);
+        V dy = Simd::sub(vpy, y);
+        V b  = Simd::mul(two, Simd::add(Simd::mul(vsdx, dx), Simd::mul(vsdy, dy)));
+        V c  = Simd::sub(Simd::add(Simd::mul(dx, dx), Simd::mul(dy, dy)), four);
+        V d  = Simd::sub(Simd::mul(b, b), Simd::mul(va4, c));
+
+        V left  = Simd::mul(Simd::sub(x, vpx), vsdy);
+        V right = Simd::mul(Simd::sub(y, vpy), vsdx);
+
+        on = Simd::bit_or(Simd::gt(d, zero), Simd::lt(Simd::abs(Simd::sub(left, right)), half));
+        in_front = Simd::bit_andnot(on, Simd::lt(right, left));
+    };
+}
+
+// Makes a test for if points are on a splitter, and if not whether they're in front, the same as ExactPredicate
+// Doubles hold the cross products exactly, as the coordinates are small whole numbers
+template <typename Simd>
+inline auto exact_point_side(float px, float py, float sdx, float sdy, std::int64_t band) {
+    using V = typename Simd::V;
+
+    const V vpx  = Simd::set(px);
+    const V vpy  = Simd::set(py);
+    const V vsdx = Simd::set(sdx);
+    const V vsdy = Simd::set(sdy);
+
+    // The cross products are whole numbers, so these are the same as ">= band" and "<= -band"
+    const V upper = Simd::set(band - 0.5);
+    const V lower = Simd::set(0.5 - band);
+
+    return [=](V x, V y, V &on, V &in_front) {
+        V cross = Simd::sub(Simd::mul(vsdx, Simd::sub(y, vpy)), Simd::mul(vsdy, Simd::sub(x, vpx)));
+
+        in_front = Simd::lt(cross, lower);
+        on = Simd::bit_not(Simd::bit_or(in_front, Simd::gt(cross, upper)));
+    };
+}
+
+// Classifies a block of segs the same way as FloatPredicate
+template <typename Simd>
+inline void classify_block_float(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                                 float px, float py, float sdx, float sdy,
+                                 std::uint64_t &front, std::uint64_t &back, std::uint64_t &split) {
+    classify_segs<Simd>(x1, y1, x2, y2, count, sdx, sdy, float_point_side<Simd>(px, py, sdx, sdy), front, back, split);
+}
+
+// Classifies a block of segs the same way as ExactPredicate
+template <typename Simd>
+inline void classify_block_exact(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                                 float px, float py, float sdx, float sdy, std::int64_t band,
+                                 std::uint64_t &front, std::uint64_t &back, std::uint64_t &split) {
+    classify_segs<Simd>(x1, y1, x2, y2, count, sdx, sdy, exact_point_side<Simd>(px, py, sdx, sdy, band), front, back, split);
+}
+
+// Classifies a block of points the same way as FloatPredicate
+template <typename Simd>
+inline void classify_points_float(const float *x, const float *y, std::size_t count,
+                                  float px, float py, float sdx, float sdy,
+                                  std::uint64_t &on, std::uint64_t &front) {
+    classify_points<Simd>(x, y, count, float_point_side<Simd>(px, py, sdx, sdy), on, front);
+}
+
+// Classifies a block of points the same way as ExactPredicate
+template <typename Simd>
+inline void classify_points_exact(const float *x, const float *y, std::size_t count,
+                                  float px, float py, float sdx, float sdy, std::int64_t band,
+                                  std::uint64_t &on, std::uint64_t &front) {
+    classify_points<Simd>(x, y, count, exact_point_side<Simd>(px, py, sdx, sdy, band), on, front);
+}
+
+}
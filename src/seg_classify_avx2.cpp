@@ -0,0 +1,150 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// This file is built with AVX2 enabled, and only gets called if the CPU supports it
+
+#ifdef __AVX2__
+
+#include "seg_classify.hpp"
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2 {
+    using V = __m256;
+    static constexpr std::size_t width = 8;
+
+    static V set(float f) { return _mm256_set1_ps(f); }
+    static V load(const float *p) { return _mm256_loadu_ps(p); }
+
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+
+    static V lt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static V gt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static V eq(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+
+    static V bit_and(V a, V b) { return _mm256_and_ps(a, b); }
+    static V bit_or (V a, V b) { return _mm256_or_ps(a, b); }
+    static V bit_andnot(V a, V b) { return _mm256_andnot_ps(a, b); }
+    static V bit_not(V a) { return _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+
+    static int mask(V a) { return _mm256_movemask_ps(a); }
+};
+
+// Converts the coordinates to doubles as they're loaded
+struct Avx2Double {
+    using V = __m256d;
+    static constexpr std::size_t width = 4;
+
+    static V set(double d) { return _mm256_set1_pd(d); }
+    static V load(const float *p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+
+    static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+
+    static V lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static V gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static V eq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+
+    static V bit_and(V a, V b) { return _mm256_and_pd(a, b); }
+    static V bit_or (V a, V b) { return _mm256_or_pd(a, b); }
+    static V bit_andnot(V a, V b) { return _mm256_andnot_pd(a, b); }
+    static V bit_not(V a) { return _mm256_xor_pd(a, _mm256_castsi256_pd(_mm256_set1_epi64x(-1))); }
+
+    static int mask(V a) { return _mm256_movemask_pd(a); }
+};
+
+}
+
+void classify_block_float_avx2(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                               float px, float py, float sdx, float sdy,
+                               std::uint64_t &front, std::uint64_t &back, std::uint64_t &split) {
+    classify_block_float<Avx2>(x1, y1, x2, y2, count, px, py, sdx, sdy, front, back, split);
+}
+
+void classify_block_exact_avx2(const float *x1, const float *y1, const float *x2, const float *y2, std::size_t count,
+                               float px, float py, float sdx, float sdy, std::int64_t band,
+                               std::uint64_t &front, std::uint64_t &back, std::uint64_t &split) {
+    classify_block_exact<Avx2Double>(x1, y1, x2, y2, count, px, py, sdx, sdy, band, front, back, split);
+}
+
+void classify_points_float_avx2(const float *x, const float *y, std::size_t count,
+                                float px, float py, float sdx, float sdy,
+                                std::uint64_t &on, std::uint64_t &front) {
+    classify_points_float<Avx2>(x, y, count, px, py, sdx, sdy, on, front);
+}
+
+void classify_points_exact_avx2(const float *x, const float *y, std::size_t count,
+                                float px, float py, float sdx, float sdy, std::int64_t band,
+                                std::uint64_t &on, std::uint64_t &front) {
+    classify_points_exact<Avx2Double>(x, y, count, px, py, sdx, sdy, band, on, front);
+}
+
+void combine_sides_avx2(const std::uint8_t *sides, const unsigned int *v1, const unsigned int *v2, const std::uint8_t *dirs, std::size_t count,
+                        std::uint8_t dir,
+                        std::uint64_t &front, std::uint64_t &back, std::uint64_t &split) {
+    const __m256i byte = _mm256_set1_epi32(0xff);
+    const __m256i on   = _mm256_set1_epi32(1);
+    const __m256i in_front = _mm256_set1_epi32(2);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i vdir = _mm256_set1_epi32(dir);
+
+    // The sides are bytes, so gather 32 bits from each one and keep the lowest byte
+    const int *base = reinterpret_cast<const int*>(sides);
+
+    auto mask = [](__m256i v) {
+        return static_cast<std::uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(v)));
+    };
+
+    front = back = split = 0;
+
+    for (std::size_t i = 0; i < count; i += 8) {
+        __m256i s1 = _mm256_and_si256(_mm256_i32gather_epi32(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v1 + i)), 1), byte);
+        __m256i s2 = _mm256_and_si256(_mm256_i32gather_epi32(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v2 + i)), 1), byte);
+        __m256i d  = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(dirs + i)));
+
+        __m256i on1 = _mm256_cmpeq_epi32(s1, on);
+        __m256i on2 = _mm256_cmpeq_epi32(s2, on);
+        __m256i front1 = _mm256_cmpeq_epi32(s1, in_front);
+        __m256i front2 = _mm256_cmpeq_epi32(s2, in_front);
+        __m256i back1  = _mm256_cmpeq_epi32(s1, zero);
+        __m256i back2  = _mm256_cmpeq_epi32(s2, zero);
+
+        // Collinear segs go in front if they point the same way as the splitter
+        __m256i collinear = _mm256_and_si256(on1, on2);
+        __m256i same_way  = _mm256_cmpeq_epi32(d, vdir);
+
+        __m256i f = _mm256_andnot_si256(_mm256_andnot_si256(same_way, collinear), _mm256_and_si256(_mm256_or_si256(front1, on1), _mm256_or_si256(front2, on2)));
+        __m256i b = _mm256_andnot_si256(_mm256_and_si256(same_way, collinear), _mm256_and_si256(_mm256_or_si256(back1, on1), _mm256_or_si256(back2, on2)));
+        __m256i s = _mm256_or_si256(_mm256_and_si256(front1, back2), _mm256_and_si256(back1, front2));
+
+        front |= mask(f) << i;
+        back  |= mask(b) << i;
+        split |= mask(s) << i;
+    }
+
+    // Ignore the padding
+    if (count < 64) {
+        std::uint64_t valid = (std::uint64_t(1) << count) - 1;
+        front &= valid;
+        back  &= valid;
+        split &= valid;
+    }
+}
+
+#endif
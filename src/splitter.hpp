@@ -17,7 +17,31 @@
 
 #include "seg.hpp"
 #include "polygon.hpp"
+#include "common.hpp"
 #include <utility>
+#include <cstdint>
+#include <cmath>
+
+class Splitter;
+
+// Classifies points the original way, using floats with some slop around the splitter
+struct FloatPredicate
+{
+    // Only axis-aligned splitters classify points the same way no matter where they start along their line
+    static constexpr bool exact = false;
+
+    static int side_of(const Splitter &splitter, const Vec2f &pt);
+};
+
+// Classifies points exactly, using 64-bit integers (Map coordinates, including the ends of cut segs, are always whole numbers)
+// A point is on the splitter if it's closer than a distance of 2 to its infinite line
+struct ExactPredicate
+{
+    // Every splitter along the same line classifies points the same way
+    static constexpr bool exact = true;
+
+    static int side_of(const Splitter &splitter, const Vec2f &pt);
+};
 
 class Splitter
 {
@@ -44,6 +68,7 @@ public:
      * @param seg The line to cut
      * @return The two new lines
      */
+    template <typename Predicate = ExactPredicate>
     std::pair<Seg, Seg> cut(const Seg &seg) const;
 
     /**
@@ -51,23 +76,205 @@ public:
      * @param poly The polygon to cut
      * @return The two new polygons
      */
+    template <typename Predicate = ExactPredicate>
     std::pair<Polyf, Polyf> cut(const Polyf &poly) const;
 
+    /**
+     * Clips a convex polygon to one side of this splitter, keeping the same part as one of the polygons from cut()
+     * @param poly The polygon to clip, which is replaced by the part that's kept
+     * @param side The side to keep, -1 for the second polygon of cut() or 1 for the first
+     * @param scratch Holds the new polygon while clipping, so it can be reused between calls
+     */
+    template <typename Predicate = ExactPredicate>
+    void clip(Polyf &poly, int side, Polyf &scratch) const;
+
     /**
      * Determines what side of this splitter a point is on
      * @param pt The point to check
      * @return -1 if on left, 0 if collinear, 1 if on right
      */
-    int side_of(const Vec2f &pt) const;
+    template <typename Predicate = ExactPredicate>
+    int side_of(const Vec2f &pt) const {
+        return Predicate::side_of(*this, pt);
+    }
 
     /**
      * Determines what side of this splitter a line is on
      * @param seg The line to check
      * @return -1 if on left, 0 if intersects, 1 if on right
      */
-    int side_of(const Seg &seg) const;
+    template <typename Predicate = ExactPredicate>
+    int side_of(const Seg &seg) const {
+        return side_of<Predicate>(seg.p1(), seg.p2());
+    }
+
+    /**
+     * Determines what side of this splitter a line is on
+     * @param p1 The start of the line
+     * @param p2 The end of the line
+     * @return -1 if on left, 0 if intersects, 1 if on right
+     */
+    template <typename Predicate = ExactPredicate>
+    int side_of(const Vec2f &p1, const Vec2f &p2) const;
 
     Vec2f p;  // Start Point
     float dx; // Delta X
     float dy; // Delta Y
+
+    std::int64_t band; // Used by ExactPredicate
 };
+
+inline int ExactPredicate::side_of(const Splitter &splitter, const Vec2f &pt) {
+    // The cross product is the distance from the line, scaled by the length of the splitter
+    std::int64_t cross = static_cast<std::int64_t>(splitter.dx) * (static_cast<std::int64_t>(pt.y) - static_cast<std::int64_t>(splitter.p.y)) -
+                         static_cast<std::int64_t>(splitter.dy) * (static_cast<std::int64_t>(pt.x) - static_cast<std::int64_t>(splitter.p.x));
+
+    return (cross >= splitter.band) - (cross <= -splitter.band);
+}
+
+template <typename Predicate>
+std::pair<Seg, Seg> Splitter::cut(const Seg &seg) const {
+    Seg l1, l2;
+
+    Vec2f p  = intersect_at(seg);
+    int side = side_of<Predicate>(seg.p1());
+
+    double ox = p.x - seg.p1().x;
+    double oy = p.y - seg.p1().y;
+    float offset = std::sqrt(ox*ox + oy*oy);
+
+    // The intersection gets rounded, so the new segs only stay on the original line if it was exact
+    double cross = static_cast<double>(seg.dx()) * oy - static_cast<double>(seg.dy()) * ox;
+    auto group = cross == 0.0 ? seg.group() : Seg::no_group;
+
+    if (side == -1) {
+        l1 = Seg(seg.p1(), p, seg.side(), seg.offset(), seg.linedef(), group);
+        l2 = Seg(p, seg.p2(), seg.side(), seg.offset()+offset, seg.linedef(), group);
+    }
+
+    else {
+        l1 = Seg(p, seg.p2(), seg.side(), seg.offset()+offset, seg.linedef(), group);
+        l2 = Seg(seg.p1(), p, seg.side(), seg.offset(), seg.linedef(), group);
+    }
+
+    return std::make_pair(l1, l2);
+}
+
+template <typename Predicate>
+std::pair<Polyf, Polyf> Splitter::cut(const Polyf &poly) const {
+    Polyf left, right;
+
+    if (!poly.size())
+        return std::make_pair(left, right);
+
+    // Each point ends one edge and starts the next, so it only needs classifying once
+    int end_side = side_of<Predicate>(poly[0]);
+
+    for (std::size_t i = 0; i < poly.size(); i++) {
+        auto start = poly[i];
+        auto end   = poly[i + 1 < poly.size() ? i + 1 : 0];
+
+        int start_side = end_side;
+        end_side = side_of<Predicate>(end);
+
+        // If the line ends on the splitter
+        if (end_side == 0) {
+            left.add(end);
+            right.add(end);
+            continue;
+        }
+
+        // If the line is completely to one side of the splitter
+        if (start_side == end_side) {
+            if (start_side == -1)
+                right.add(end);
+            else
+                left.add(end);
+            continue;
+        }
+
+        // Else it intersects
+        auto p = intersect_at(Linef(start, end));
+
+        // If the line ends on the left of the splitter
+        if (end_side == -1) {
+            left.add(p);
+            right.add(p);
+            right.add(end);
+        }
+
+        // Or if the line ends on the right of the splitter
+        else {
+            right.add(p);
+            left.add(p);
+            left.add(end);
+        }
+    }
+
+    return std::make_pair(left, right);
+}
+
+template <typename Predicate>
+void Splitter::clip(Polyf &poly, int side, Polyf &scratch) const {
+    if (!poly.size())
+        return;
+
+    scratch.clear();
+
+    int end_side = side_of<Predicate>(poly[0]);
+
+    // The same as cut(), but only building one side
+    for (std::size_t i = 0; i < poly.size(); i++) {
+        auto start = poly[i];
+        auto end   = poly[i + 1 < poly.size() ? i + 1 : 0];
+
+        int start_side = end_side;
+        end_side = side_of<Predicate>(end);
+
+        if (end_side == 0) {
+            scratch.add(end);
+            continue;
+        }
+
+        if (start_side == end_side) {
+            if (start_side == side)
+                scratch.add(end);
+            continue;
+        }
+
+        scratch.add(intersect_at(Linef(start, end)));
+
+        if (end_side == side)
+            scratch.add(end);
+    }
+
+    std::swap(poly, scratch);
+}
+
+template <typename Predicate>
+int Splitter::side_of(const Vec2f &p1, const Vec2f &p2) const {
+    int s1 = side_of<Predicate>(p1);
+    int s2 = side_of<Predicate>(p2);
+
+    if (s1 == s2) {
+        // Check if the line is collinear with the splitter
+        if (!s1) {
+            float dx2 = p2.x - p1.x;
+            float dy2 = p2.y - p1.y;
+
+            // If the line is going the same direction as the splitter, put it on the left
+            if (Common::sign(dx) == Common::sign(dx2) && Common::sign(dy) == Common::sign(dy2))
+                return -1; // Left
+            else
+                return 1; // Right
+        }
+
+        return s1;
+    }
+
+    // If one of the points is collinear with the splitter, use the other point
+    if (!s1) return s2;
+    if (!s2) return s1;
+
+    return 0; // It intersects
+}
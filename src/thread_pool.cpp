@@ -0,0 +1,195 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "thread_pool.hpp"
+#include <algorithm>
+
+// The pool and queue that the current thread belongs to
+static thread_local const ThreadPool *current_pool = nullptr;
+static thread_local unsigned int current_index = 0;
+
+ThreadPool::ThreadPool(unsigned int threads) : queued(0), stopping(false) {
+    if (!threads)
+        threads = 1;
+
+    // Queue 0 is shared by any threads outside of the pool
+    for (unsigned int i = 0; i < threads; i++)
+        queues.push_back(std::make_unique<Queue>());
+
+    for (unsigned int i = 1; i < threads; i++)
+        workers.emplace_back(&ThreadPool::worker, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+
+    worker_cond.notify_all();
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::run(Group &group, std::function<void()> task) {
+    group.pending_++;
+    group.queued_++;
+
+    auto &queue = *queues[queue_index()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(Task{&group, std::move(task)});
+    }
+
+    queued++;
+
+    // Wake up an idle worker to come steal it, and anyone waiting on the group who could help out
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    worker_cond.notify_one();
+    group_cond.notify_all();
+}
+
+void ThreadPool::wait(Group &group) {
+    auto index = queue_index();
+
+    while (group.pending_) {
+        Task task;
+
+        // Help out while waiting, newest tasks first as they're most likely our own
+        // Only tasks from the same group are run, so that waiting never piles unrelated work onto this thread's stack
+        if (pop(index, task, &group) || steal(index, task, &group)) {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        group_cond.wait(lock, [&]() { return !group.pending_ || group.queued_; });
+    }
+
+    if (group.error_) {
+        auto error = group.error_;
+        group.error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::parallel_for(std::size_t count, std::size_t chunks, const std::function<void(std::size_t begin, std::size_t end, std::size_t chunk)> &func) {
+    chunks = std::max<std::size_t>(1, std::min(chunks, count));
+
+    Group group;
+    std::size_t begin = 0;
+
+    for (std::size_t i = 0; i < chunks; i++) {
+        std::size_t end = count * (i + 1) / chunks;
+
+        // Run the last chunk on this thread
+        if (i == chunks - 1)
+            func(begin, end, i);
+        else
+            run(group, [=, &func]() { func(begin, end, i); });
+
+        begin = end;
+    }
+
+    wait(group);
+}
+
+bool ThreadPool::pop(unsigned int index, Task &task, const Group *group) {
+    auto &queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    // Find the newest task that we're allowed to take
+    auto it = std::find_if(queue.tasks.rbegin(), queue.tasks.rend(), [&](const Task &t) { return !group || t.group == group; });
+
+    if (it == queue.tasks.rend())
+        return false;
+
+    task = std::move(*it);
+    queue.tasks.erase(std::next(it).base());
+    task.group->queued_--;
+    queued--;
+
+    return true;
+}
+
+bool ThreadPool::steal(unsigned int index, Task &task, const Group *group) {
+    // Take the oldest task from someone else, as it's likely to be the largest
+    for (std::size_t i = 1; i < queues.size(); i++) {
+        auto &queue = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        auto it = std::find_if(queue.tasks.begin(), queue.tasks.end(), [&](const Task &t) { return !group || t.group == group; });
+
+        if (it == queue.tasks.end())
+            continue;
+
+        task = std::move(*it);
+        queue.tasks.erase(it);
+        task.group->queued_--;
+        queued--;
+
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::execute(Task &task) {
+    auto &group = *task.group;
+
+    try {
+        task.func();
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(group.error_mutex_);
+        if (!group.error_)
+            group.error_ = std::current_exception();
+    }
+
+    // Let anyone waiting on the group know that it's finished
+    if (--group.pending_ == 0) {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        group_cond.notify_all();
+    }
+}
+
+void ThreadPool::worker(unsigned int index) {
+    current_pool  = this;
+    current_index = index;
+
+    while (true) {
+        Task task;
+
+        if (pop(index, task) || steal(index, task)) {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        worker_cond.wait(lock, [&]() { return stopping || queued; });
+
+        if (stopping)
+            return;
+    }
+}
+
+unsigned int ThreadPool::queue_index() const {
+    return current_pool == this ? current_index : 0;
+}
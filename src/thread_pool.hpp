@@ -0,0 +1,106 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // A set of tasks that can be waited on together
+    class Group
+    {
+    public:
+        Group() : pending_(0), queued_(0) {
+        }
+
+    private:
+        friend class ThreadPool;
+
+        std::atomic<unsigned int> pending_; // Tasks that haven't finished
+        std::atomic<unsigned int> queued_;  // Tasks that haven't started
+        std::mutex error_mutex_;
+        std::exception_ptr error_;
+    };
+
+    /**
+     * Creates a pool for running tasks in parallel
+     * @param threads The total number of threads, including the one that calls wait()
+     */
+    ThreadPool(unsigned int threads);
+    ~ThreadPool();
+
+    /**
+     * Queues a task to be run by any thread in the pool
+     * @param group The group that the task belongs to
+     * @param task The task to run
+     */
+    void run(Group &group, std::function<void()> task);
+
+    /**
+     * Waits for all the tasks in a group to finish, running queued tasks from the group in the meantime
+     * @param group The group to wait on
+     */
+    void wait(Group &group);
+
+    /**
+     * Splits a range of indices into chunks and runs them all in parallel, waiting for them to finish
+     * @param count The number of indices
+     * @param chunks The number of chunks to split the range into
+     * @param func Called with the [begin, end) range of each chunk, and the index of that chunk
+     */
+    void parallel_for(std::size_t count, std::size_t chunks, const std::function<void(std::size_t begin, std::size_t end, std::size_t chunk)> &func);
+
+    unsigned int size() const { return queues.size(); }
+
+private:
+    struct Task {
+        Group *group;
+        std::function<void()> func;
+    };
+
+    // Every thread has its own queue, which others can steal from when idle
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // If a group is given, only a task from that group is taken
+    bool pop(unsigned int index, Task &task, const Group *group = nullptr);
+    bool steal(unsigned int index, Task &task, const Group *group = nullptr);
+    void execute(Task &task);
+    void worker(unsigned int index);
+
+    unsigned int queue_index() const;
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    // Idle workers and threads waiting on a group sleep separately, so that waking one worker can't be swallowed by a waiter
+    std::mutex sleep_mutex;
+    std::condition_variable worker_cond;
+    std::condition_variable group_cond;
+    std::atomic<unsigned int> queued;
+    bool stopping;
+};
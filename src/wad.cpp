@@ -50,6 +50,12 @@ Wad::Wad(const std::string &path) : path_(path), changed(false), map_start(nullp
     find_maps();
 }
 
+Wad::Wad() : changed(true), map_start(nullptr), map_end(nullptr) {
+    std::copy_n("PWAD", 4, header.id);
+    header.num_lumps  = 0;
+    header.dir_offset = sizeof(Header);
+}
+
 Wad::~Wad() {
     file.close();
 }
@@ -161,6 +167,8 @@ std::uint32_t Wad::file_size() const {
 
 std::vector<std::string> Wad::maps() const {
     std::vector<std::string> maps;
+    if (!map_start)
+        return maps;
 
     // Find the names of all the maps
     for (LumpInfo *lump = map_start; lump <= map_end; lump++) {
@@ -245,6 +253,18 @@ bool Wad::insert_map_lump(const std::string &map, const std::string &after, cons
     return true;
 }
 
+void Wad::add(const std::string &name, const void *data, std::size_t size) {
+    LumpInfo lump;
+
+    lump.lump.pos = 0;
+    std::fill_n(lump.lump.name, 8, 0);
+    std::copy_n(&name[0], std::min<std::size_t>(name.size(), 8), lump.lump.name);
+
+    lumps.push_back(std::move(lump));
+    write(&lumps.back(), data, size);
+    find_maps();
+}
+
 void Wad::remove(const std::string &name) {
     auto lump = find_lump(name);
     if (!lump)
@@ -300,8 +320,11 @@ void Wad::insert(LumpInfo *after, const std::string &name, const void *data, std
     std::fill_n(lump.lump.name, 8, 0);
     std::copy_n(&name[0], std::min<std::size_t>(name.size(), 8), lump.lump.name);
 
-    lumps.insert(lumps.begin() + lump_index(after), std::move(lump));
-    write(after + 1, data, size);
+    // Inserting can move the lumps, so only use the index from here on
+    auto index = lump_index(after) + 1;
+    lumps.insert(lumps.begin() + index, std::move(lump));
+    write(&lumps[index], data, size);
+    find_maps();
 }
 
 Wad::LumpInfo *Wad::find_lump(const std::string &name) {
@@ -337,7 +360,7 @@ Wad::LumpInfo *Wad::find_map_lump(const std::string &map, const std::string &nam
         return nullptr;
 
     // Find the end of the map's lumps
-    end = start + (&lumps.back()-end-10 >= 0 ? 10 : &lumps.back()-end);
+    end = start + std::min<std::ptrdiff_t>(10, &lumps.back() - start);
 
     // Now find the actual lump
     for (LumpInfo *lump = start+1; lump <= end; lump++) {
@@ -398,10 +421,13 @@ void Wad::find_maps() {
         }
     }
 
+    if (!map_start)
+        return;
+
     // Find the last map
     for (std::size_t end = lumps.size() - 1; end >= first; end--) {
-        if (is_map(lumps[first].lump.name)) {
-            map_end = &lumps[end] + (lumps.size()-end-11 >= 0 ? 10 : lumps.size()-end-1); // Add the correct offset without overflowing
+        if (is_map(lumps[end].lump.name)) {
+            map_end = &lumps[std::min(end + 10, lumps.size() - 1)]; // Add the correct offset without overflowing
             break;
         }
     }
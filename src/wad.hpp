@@ -24,6 +24,9 @@ class Wad
 {
 public:
     Wad(const std::string &path);
+
+    // Creates an empty PWAD that only exists in memory until it's saved
+    Wad();
     ~Wad();
 
     bool save(const std::string &new_path);
@@ -37,6 +40,7 @@ public:
     std::unique_ptr<std::uint8_t[]> read(const std::string &name, std::size_t &size);
     bool write(const std::string &name, const void *data, std::size_t size);
     bool insert(const std::string &after, const std::string &name, const void *data, std::size_t size);
+    void add(const std::string &name, const void *data, std::size_t size);
 
     std::unique_ptr<std::uint8_t[]> read_map_lump(const std::string &map, const std::string &name, std::size_t &size);
     bool write_map_lump(const std::string &map, const std::string &name, const void *data, std::size_t size);
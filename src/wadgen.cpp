@@ -0,0 +1,99 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "wad.hpp"
+#include "map_generator.hpp"
+
+// Writes PWADs of generated maps, for measuring how building scales with the size and shape of a map
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " [WAD PATH] [TOPOLOGY:LINEDEFS...] [--seed N]" << std::endl;
+        std::cerr << "Topologies: grid, polygons, spiral, collinear, diagonals" << std::endl;
+        return 1;
+    }
+
+    std::string path = argv[1];
+    std::vector<std::pair<MapGenerator::Topology, int>> maps;
+    unsigned int seed = 1;
+
+    for (auto i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--seed" && i + 1 < argc) {
+            try {
+                seed = std::stoul(argv[++i]);
+            }
+            catch (const std::exception&) {
+                std::cerr << "Invalid seed " << argv[i] << std::endl;
+                return 1;
+            }
+            continue;
+        }
+
+        auto colon = arg.find(':');
+        MapGenerator::Topology topology;
+        int linedefs;
+
+        try {
+            if (colon == std::string::npos || !MapGenerator::parse_topology(arg.substr(0, colon), topology))
+                throw std::invalid_argument(arg);
+
+            linedefs = std::stoi(arg.substr(colon + 1));
+        }
+        catch (const std::exception&) {
+            std::cerr << "Invalid map " << arg << ", expected something like grid:1000" << std::endl;
+            return 1;
+        }
+
+        maps.emplace_back(topology, linedefs);
+    }
+
+    if (maps.size() > 99) {
+        std::cerr << "Too many maps, the most is 99" << std::endl;
+        return 1;
+    }
+
+    try {
+        Wad wad;
+
+        for (std::size_t i = 0; i < maps.size(); i++) {
+            std::string name = (i < 9 ? "MAP0" : "MAP") + std::to_string(i + 1);
+
+            auto generator = MapGenerator::generate(maps[i].first, maps[i].second, seed);
+            generator.write(wad, name);
+
+            std::cout << name << "\t" << MapGenerator::topology_name(maps[i].first) << "\t"
+                      << generator.num_linedefs() << " linedefs\t"
+                      << generator.num_vertices() << " vertices\t"
+                      << generator.num_sectors() << " sectors" << std::endl;
+        }
+
+        if (!wad.save(path)) {
+            std::cerr << "Unable to write " << path << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
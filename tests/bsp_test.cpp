@@ -0,0 +1,407 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+#include "bsp.hpp"
+#include "map.hpp"
+#include "map_generator.hpp"
+#include "wad.hpp"
+#include <cmath>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef NODEBUILDER_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+    std::vector<std::uint8_t> lump(const Map &map, const std::string &name) {
+        std::size_t size;
+        auto data = map.get_lump(name, size);
+
+        return std::vector<std::uint8_t>(data, data + size);
+    }
+
+    // Builds a map on its own, without touching the WAD
+    Map build(Wad &wad, const std::string &name, const BuildOptions &options) {
+        Map map(name, wad);
+        map.load();
+
+        Bsp bsp(map);
+        bsp.build(nullptr, nullptr, options);
+        bsp.save();
+
+        return map;
+    }
+
+    // The total length and number of the segs on each side of each linedef
+    using Coverage = std::map<std::pair<std::size_t, int>, std::pair<double, int>>;
+
+    // Checks that the saved vanilla nodes reach every subsector once, and that the segs cover every side of every linedef
+    void check_nodes(const Map &map, Coverage &sides) {
+        auto vertices = map.get_vertices();
+        auto linedefs = map.get_linedefs();
+        auto segs     = map.get_segs();
+        auto ssectors = map.get_ssectors();
+        auto nodes    = map.get_nodes();
+
+        ASSERT_GT(map.num_nodes(), 0);
+
+        std::size_t next_seg = 0;
+        for (std::size_t i = 0; i < map.num_ssectors(); i++) {
+            EXPECT_EQ(ssectors[i].first, next_seg);
+            next_seg += ssectors[i].count;
+        }
+        EXPECT_EQ(next_seg, map.num_segs());
+
+        // The root is saved last, after its children
+        std::vector<int> reached(map.num_ssectors(), 0);
+        std::vector<std::size_t> stack = { map.num_nodes() - 1 };
+
+        while (!stack.empty()) {
+            auto index = stack.back();
+            stack.pop_back();
+
+            for (auto child : nodes[index].child) {
+                if (child & 0x8000) {
+                    ASSERT_LT(child & 0x7fff, map.num_ssectors());
+                    reached[child & 0x7fff]++;
+                }
+                else {
+                    ASSERT_LT(child, index);
+                    stack.push_back(child);
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < reached.size(); i++)
+            EXPECT_EQ(reached[i], 1) << "Subsector " << i;
+
+        // The segs of each side of a linedef add up to its length, give or take the rounding of where they were cut
+        for (std::size_t i = 0; i < map.num_segs(); i++) {
+            ASSERT_LT(segs[i].linedef, map.num_linedefs());
+            ASSERT_LT(segs[i].start, map.num_vertices());
+            ASSERT_LT(segs[i].end, map.num_vertices());
+
+            const auto &start = vertices[segs[i].start], &end = vertices[segs[i].end];
+            auto &side = sides[{segs[i].linedef, segs[i].dir}];
+
+            side.first  += std::hypot(end.x - start.x, end.y - start.y);
+            side.second += 1;
+        }
+
+        for (std::size_t i = 0; i < map.num_linedefs(); i++) {
+            const auto &start = vertices[linedefs[i].start], &end = vertices[linedefs[i].end];
+            auto length = std::hypot(end.x - start.x, end.y - start.y);
+
+            for (int dir = 0; dir < ((linedefs[i].flags & 0b100) ? 2 : 1); dir++) {
+                auto side = sides[{i, dir}];
+                EXPECT_NEAR(side.first, length, 1.5 * side.second) << "Linedef " << i << " side " << dir;
+            }
+        }
+    }
+
+    // Reads the little endian fields of an extended nodes lump in order
+    class Reader {
+    public:
+        Reader(const std::vector<std::uint8_t> &data, std::size_t pos) : data(data), pos(pos) {
+        }
+
+        std::uint32_t u8() {
+            return pos < data.size() ? data[pos++] : (overrun = true, 0);
+        }
+
+        std::uint32_t u16() {
+            auto low = u8();
+            return low | u8() << 8;
+        }
+
+        std::uint32_t u32() {
+            auto low = u16();
+            return low | u16() << 16;
+        }
+
+        bool done() const { return !overrun && pos == data.size(); }
+
+    private:
+        const std::vector<std::uint8_t> &data;
+        std::size_t pos;
+        bool overrun = false;
+    };
+
+    // Checks that XNOD nodes hold the same tree as the vanilla nodes of the same build
+    void check_extended(const Map &extended, const Map &vanilla, const std::vector<std::uint8_t> &data) {
+        ASSERT_GE(data.size(), 4);
+        ASSERT_EQ(std::string(data.begin(), data.begin() + 4), "XNOD");
+
+        auto vertices = vanilla.get_vertices();
+        auto segs     = vanilla.get_segs();
+        auto ssectors = vanilla.get_ssectors();
+        auto nodes    = vanilla.get_nodes();
+
+        Reader reader(data, 4);
+
+        // The vertices of the linedefs stay in VERTEXES, and the rest come after them
+        std::vector<std::pair<int, int>> all_vertices;
+        auto org_vertices = reader.u32();
+        auto new_vertices = reader.u32();
+
+        ASSERT_EQ(extended.num_vertices(), org_vertices);
+        ASSERT_EQ(vanilla.num_vertices(), org_vertices + new_vertices);
+
+        for (std::size_t i = 0; i < org_vertices; i++)
+            all_vertices.emplace_back(extended.get_vertices()[i].x, extended.get_vertices()[i].y);
+
+        for (std::size_t i = 0; i < new_vertices; i++) {
+            auto x = reader.u32(), y = reader.u32();
+            all_vertices.emplace_back(static_cast<std::int32_t>(x) >> 16, static_cast<std::int32_t>(y) >> 16);
+        }
+
+        for (std::size_t i = 0; i < all_vertices.size(); i++) {
+            EXPECT_EQ(all_vertices[i].first, vertices[i].x) << "Vertex " << i;
+            EXPECT_EQ(all_vertices[i].second, vertices[i].y) << "Vertex " << i;
+        }
+
+        ASSERT_EQ(reader.u32(), vanilla.num_ssectors());
+        for (std::size_t i = 0; i < vanilla.num_ssectors(); i++)
+            EXPECT_EQ(reader.u32(), ssectors[i].count) << "Subsector " << i;
+
+        ASSERT_EQ(reader.u32(), vanilla.num_segs());
+        for (std::size_t i = 0; i < vanilla.num_segs(); i++) {
+            EXPECT_EQ(reader.u32(), segs[i].start) << "Seg " << i;
+            EXPECT_EQ(reader.u32(), segs[i].end) << "Seg " << i;
+            EXPECT_EQ(reader.u16(), segs[i].linedef) << "Seg " << i;
+            EXPECT_EQ(reader.u8(), segs[i].dir) << "Seg " << i;
+        }
+
+        ASSERT_EQ(reader.u32(), vanilla.num_nodes());
+        for (std::size_t i = 0; i < vanilla.num_nodes(); i++) {
+            for (auto field : { nodes[i].x, nodes[i].y, nodes[i].dx, nodes[i].dy })
+                EXPECT_EQ(static_cast<std::int16_t>(reader.u16()), field) << "Node " << i;
+
+            for (auto bound : nodes[i].lbounds)
+                EXPECT_EQ(static_cast<std::int16_t>(reader.u16()), bound) << "Node " << i;
+            for (auto bound : nodes[i].rbounds)
+                EXPECT_EQ(static_cast<std::int16_t>(reader.u16()), bound) << "Node " << i;
+
+            // Subsectors are flagged by the top bit of all 32
+            for (auto child : nodes[i].child) {
+                auto expected = (child & 0x8000) ? (child & 0x7fff) | 0x80000000u : child;
+                EXPECT_EQ(reader.u32(), expected) << "Node " << i;
+            }
+        }
+
+        EXPECT_TRUE(reader.done());
+
+        // Everything is in the nodes
+        EXPECT_EQ(extended.num_segs(), 0);
+        EXPECT_EQ(extended.num_ssectors(), 0);
+        EXPECT_EQ(lump(extended, "LINEDEFS"), lump(vanilla, "LINEDEFS"));
+    }
+
+    // Edits a map and rebuilds it many times over, comparing it with a full build of the same edits each time
+    // A rebuild keeps splitters that a full build might not choose, so the trees only have to cover the same linedefs with about as many segs and nodes
+    template <typename Edit>
+    void check_rebuilds(Edit &&edit) {
+        Wad wad;
+        MapGenerator::generate(MapGenerator::Topology::Polygons, 2000).write(wad, "MAP01");
+
+        Map map("MAP01", wad);
+        map.load();
+
+        Bsp bsp(map);
+        bsp.build();
+        bsp.save();
+
+        auto first = bsp.stats();
+
+        for (int i = 0; i < 20; i++) {
+            SCOPED_TRACE("Edit " + std::to_string(i));
+            edit(map, i);
+
+            Map full("MAP01", wad);
+            full.load();
+            full.replace_vertices(map.get_vertices(), map.num_vertices());
+            full.replace_linedefs(map.get_linedefs(), map.num_linedefs());
+
+            bsp.rebuild();
+            bsp.save();
+
+            Coverage rebuilt_sides, full_sides;
+            {
+                SCOPED_TRACE("Rebuilt");
+                check_nodes(map, rebuilt_sides);
+            }
+
+            // Nothing from the trees before is kept
+            auto stats = bsp.stats();
+            EXPECT_EQ(stats.pooled_segs, stats.segs);
+            EXPECT_EQ(stats.pooled_nodes, stats.nodes + stats.leaves);
+            EXPECT_LT(stats.pooled_segs, 2 * first.segs);
+
+            Bsp full_bsp(full);
+            full_bsp.build();
+            full_bsp.save();
+            {
+                SCOPED_TRACE("Full");
+                check_nodes(full, full_sides);
+            }
+
+            auto full_stats = full_bsp.stats();
+            EXPECT_LE(stats.segs, full_stats.segs * 21 / 20);
+            EXPECT_LE(stats.nodes, full_stats.nodes * 21 / 20);
+
+            ASSERT_EQ(rebuilt_sides.size(), full_sides.size());
+            for (const auto &[key, side] : full_sides) {
+                auto rebuilt = rebuilt_sides[key];
+                EXPECT_NEAR(rebuilt.first, side.first, 1.5 * (rebuilt.second + side.second)) << "Linedef " << key.first << " side " << key.second;
+            }
+        }
+    }
+}
+
+// Scoring one seg of each line going each way has to give the same tree as scoring them all
+TEST(BspTest, CollinearGroupsDontChangeTree) {
+    Wad wad;
+    MapGenerator::generate(MapGenerator::Topology::Grid, 1000).write(wad, "MAP01");
+    MapGenerator::generate(MapGenerator::Topology::Polygons, 2000).write(wad, "MAP02");
+    MapGenerator::generate(MapGenerator::Topology::Polygons, 4000, 3).write(wad, "MAP03");
+
+    for (auto name : { "MAP01", "MAP02", "MAP03" }) {
+        for (bool exact : { true, false }) {
+            BuildOptions grouped, ungrouped;
+            grouped.exact   = exact;
+            ungrouped.exact = exact;
+            ungrouped.collinear_groups = false;
+
+            auto expected = build(wad, name, ungrouped);
+            auto actual   = build(wad, name, grouped);
+
+            for (auto lump_name : { "VERTEXES", "SEGS", "SSECTORS", "NODES" })
+                EXPECT_EQ(lump(actual, lump_name), lump(expected, lump_name)) << name << " " << lump_name << (exact ? "" : " with --float");
+        }
+    }
+}
+
+TEST(BspTest, RebuildAfterMovingVertex) {
+    check_rebuilds([](Map &map, int i) {
+        std::vector<Map::Vertex> vertices(map.get_vertices(), map.get_vertices() + map.num_vertices());
+        const auto &linedef = map.get_linedefs()[i * 37 % map.num_linedefs()];
+
+        vertices[linedef.start].x += 3;
+        vertices[linedef.start].y -= 5;
+        map.replace_vertices(vertices.data(), vertices.size());
+    });
+}
+
+TEST(BspTest, RebuildAfterDeletingLinedefs) {
+    check_rebuilds([](Map &map, int) {
+        std::vector<Map::LineDef> linedefs(map.get_linedefs(), map.get_linedefs() + map.num_linedefs());
+
+        linedefs.erase(linedefs.end() - 3, linedefs.end());
+        map.replace_linedefs(linedefs.data(), linedefs.size());
+    });
+}
+
+TEST(BspTest, SavesXNod) {
+    Wad wad;
+    MapGenerator::generate(MapGenerator::Topology::Polygons, 2000).write(wad, "MAP01");
+
+    Map vanilla("MAP01", wad), extended("MAP01", wad);
+    vanilla.load();
+    extended.load();
+
+    Bsp vanilla_bsp(vanilla), extended_bsp(extended);
+    vanilla_bsp.build();
+    extended_bsp.build();
+
+    EXPECT_EQ(vanilla_bsp.save(), Bsp::Format::Vanilla);
+    EXPECT_EQ(extended_bsp.save(Bsp::Format::XNod), Bsp::Format::XNod);
+
+    EXPECT_TRUE(extended.extended_nodes());
+    EXPECT_EQ(Bsp::saved_format(extended), Bsp::Format::XNod);
+    EXPECT_EQ(Bsp::saved_format(vanilla), Bsp::Format::Vanilla);
+
+    check_extended(extended, vanilla, lump(extended, "NODES"));
+}
+
+#ifdef NODEBUILDER_ZLIB
+TEST(BspTest, SavesZNod) {
+    Wad wad;
+    MapGenerator::generate(MapGenerator::Topology::Polygons, 2000).write(wad, "MAP01");
+
+    Map xnod("MAP01", wad), znod("MAP01", wad);
+    xnod.load();
+    znod.load();
+
+    Bsp xnod_bsp(xnod), znod_bsp(znod);
+    xnod_bsp.build();
+    znod_bsp.build();
+    xnod_bsp.save(Bsp::Format::XNod);
+
+    EXPECT_EQ(znod_bsp.save(Bsp::Format::ZNod), Bsp::Format::ZNod);
+    EXPECT_EQ(Bsp::saved_format(znod), Bsp::Format::ZNod);
+
+    // Everything after the magic inflates to the same as XNOD
+    auto compressed = lump(znod, "NODES");
+    auto expected   = lump(xnod, "NODES");
+
+    ASSERT_EQ(std::string(compressed.begin(), compressed.begin() + 4), "ZNOD");
+
+    std::vector<std::uint8_t> inflated(expected.size() - 4);
+    uLongf size = inflated.size();
+
+    ASSERT_EQ(uncompress(inflated.data(), &size, compressed.data() + 4, compressed.size() - 4), Z_OK);
+    EXPECT_EQ(size, inflated.size());
+    EXPECT_TRUE(std::equal(inflated.begin(), inflated.end(), expected.begin() + 4));
+
+    EXPECT_EQ(lump(znod, "VERTEXES"), lump(xnod, "VERTEXES"));
+}
+#endif
+
+// Maps fall back on extended nodes only once they no longer fit in vanilla ones
+TEST(BspTest, AutoFormat) {
+    Wad wad;
+    MapGenerator::generate(MapGenerator::Topology::Grid, 1000).write(wad, "MAP01");
+    MapGenerator::generate(MapGenerator::Topology::Grid, 34000).write(wad, "MAP02");
+
+    Map small("MAP01", wad);
+    small.load();
+
+    Bsp small_bsp(small);
+    small_bsp.build();
+    EXPECT_EQ(small_bsp.save(), Bsp::Format::Vanilla);
+
+    Map big("MAP02", wad);
+    big.load();
+
+    Bsp big_bsp(big);
+    big_bsp.build();
+
+    // More segs than 16-bit indices can reach
+    EXPECT_GT(big_bsp.stats().segs, 0xffff);
+    EXPECT_THROW(big_bsp.save(Bsp::Format::Vanilla), std::runtime_error);
+
+#ifdef NODEBUILDER_ZLIB
+    EXPECT_EQ(big_bsp.save(), Bsp::Format::ZNod);
+#else
+    EXPECT_EQ(big_bsp.save(), Bsp::Format::XNod);
+    EXPECT_THROW(big_bsp.save(Bsp::Format::ZNod), std::runtime_error);
+#endif
+
+    EXPECT_TRUE(big.extended_nodes());
+}
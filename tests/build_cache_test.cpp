@@ -0,0 +1,161 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+#include "build_cache.hpp"
+#include "bsp.hpp"
+#include "hash.hpp"
+#include "map.hpp"
+#include "map_generator.hpp"
+#include "wad.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    std::vector<std::uint8_t> lump(const Map &map, const std::string &name) {
+        std::size_t size;
+        auto data = map.get_lump(name, size);
+
+        return std::vector<std::uint8_t>(data, data + size);
+    }
+
+    // A cache in a directory of its own, which is removed afterwards
+    class BuildCacheTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            path = std::filesystem::temp_directory_path() / ("nodebuilder_test_" + std::to_string(std::random_device()()));
+            MapGenerator::generate(MapGenerator::Topology::Grid, 200).write(wad, "MAP01");
+        }
+
+        void TearDown() override {
+            std::error_code error;
+            std::filesystem::remove_all(path, error);
+        }
+
+        // Builds the map and stores it, returning the path of the file it was stored in
+        std::filesystem::path store(BuildCache &cache, std::uint64_t key) {
+            Map map("MAP01", wad);
+            map.load();
+
+            Bsp bsp(map);
+            bsp.build();
+            bsp.save();
+
+            cache.store(key, map);
+
+            for (const auto &entry : std::filesystem::directory_iterator(path)) {
+                if (entry.path().extension() == ".lumps")
+                    return entry.path();
+            }
+
+            return {};
+        }
+
+        std::vector<char> read(const std::filesystem::path &file) {
+            std::ifstream in(file, std::ios::in | std::ios::binary);
+            return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+
+        void write(const std::filesystem::path &file, const std::vector<char> &contents) {
+            std::ofstream out(file, std::ios::out | std::ios::binary | std::ios::trunc);
+            out.write(contents.data(), contents.size());
+        }
+
+        // Loading a damaged entry has to be a miss that leaves the map as it was
+        void expect_miss(BuildCache &cache, std::uint64_t key) {
+            Map map("MAP01", wad);
+            map.load();
+
+            auto vertices = lump(map, "VERTEXES");
+            auto linedefs = lump(map, "LINEDEFS");
+
+            EXPECT_FALSE(cache.load(key, map));
+            EXPECT_EQ(lump(map, "VERTEXES"), vertices);
+            EXPECT_EQ(lump(map, "LINEDEFS"), linedefs);
+            EXPECT_EQ(map.num_nodes(), 0);
+        }
+
+        std::filesystem::path path;
+        Wad wad;
+    };
+}
+
+TEST_F(BuildCacheTest, Hit) {
+    BuildCache cache(path.string(), "test");
+    ASSERT_FALSE(store(cache, 1).empty());
+
+    Map map("MAP01", wad);
+    map.load();
+
+    EXPECT_TRUE(cache.load(1, map));
+    EXPECT_GT(map.num_nodes(), 0);
+    EXPECT_EQ(cache.hits(), 1);
+    EXPECT_EQ(cache.misses(), 0);
+}
+
+TEST_F(BuildCacheTest, Truncated) {
+    BuildCache cache(path.string(), "test");
+    auto file = store(cache, 1);
+    auto contents = read(file);
+
+    for (std::size_t size : { std::size_t(0), std::size_t(5), contents.size() / 2, contents.size() - 1 }) {
+        write(file, std::vector<char>(contents.begin(), contents.begin() + size));
+        expect_miss(cache, 1);
+    }
+
+    EXPECT_EQ(cache.hits(), 0);
+}
+
+TEST_F(BuildCacheTest, Corrupt) {
+    BuildCache cache(path.string(), "test");
+    auto file = store(cache, 1);
+    auto contents = read(file);
+
+    contents[contents.size() / 2] ^= 1;
+    write(file, contents);
+
+    expect_miss(cache, 1);
+}
+
+TEST_F(BuildCacheTest, UnreplaceableLump) {
+    BuildCache cache(path.string(), "test");
+    auto file = store(cache, 1);
+    auto contents = read(file);
+
+    // A lump that can't be replaced after ones that can, with the hash made to match so only the size gives it away
+    contents.resize(contents.size() - sizeof(std::uint64_t));
+
+    char entry[12] = "SEGS";
+    std::uint32_t size = 5;
+    std::memcpy(entry + 8, &size, sizeof(size));
+
+    contents.insert(contents.end(), entry, entry + sizeof(entry));
+    contents.insert(contents.end(), size, 0);
+
+    Hash64 hash;
+    hash.update(contents.data(), contents.size());
+
+    auto digest = hash.digest();
+    auto bytes  = reinterpret_cast<const char*>(&digest);
+    contents.insert(contents.end(), bytes, bytes + sizeof(digest));
+    write(file, contents);
+
+    expect_miss(cache, 1);
+}
@@ -26,3 +26,9 @@ TEST(CommonTest, Sign) {
     EXPECT_EQ(Common::sign(100), 1);
     EXPECT_EQ(Common::sign(-100), -1);
 }
+
+TEST(CommonTest, Popcount) {
+    EXPECT_EQ(Common::popcount(0), 0);
+    EXPECT_EQ(Common::popcount(0xF0F0), 8);
+    EXPECT_EQ(Common::popcount(~std::uint64_t(0)), 64);
+}
@@ -0,0 +1,45 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+#include "hash.hpp"
+
+static std::uint64_t hash_of(const std::string &text) {
+    Hash64 hash;
+    hash.update(text.data(), text.size());
+    return hash.digest();
+}
+
+TEST(HashTest, KnownValues) {
+    EXPECT_EQ(hash_of(""),    0xEF46DB3751D8E999ull);
+    EXPECT_EQ(hash_of("a"),   0xD24EC4F1A98C6E5Bull);
+    EXPECT_EQ(hash_of("abc"), 0x44BC2CF5AD770999ull);
+    EXPECT_EQ(hash_of("Nobody inspects the spammish repetition"), 0xFBCEA83C8A378BF1ull);
+}
+
+TEST(HashTest, Streaming) {
+    std::string text;
+    for (int i = 0; i < 200; i++)
+        text += static_cast<char>(i * 7);
+
+    // Splitting the data up any way gives the same hash
+    for (std::size_t step = 1; step < 70; step += 3) {
+        Hash64 hash;
+        for (std::size_t i = 0; i < text.size(); i += step)
+            hash.update(text.data() + i, std::min(step, text.size() - i));
+
+        EXPECT_EQ(hash.digest(), hash_of(text));
+    }
+}
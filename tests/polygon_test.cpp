@@ -71,3 +71,29 @@ TEST(PolyTest, Bounds) {
 
     EXPECT_EQ(poly.bounds(), Boxf(Vec2f(0.0f, 0.0f), Vec2f(10.0f, 10.0f)));
 }
+
+TEST(PolyTest, ManyPoints) {
+    Polyf poly;
+
+    // Enough points to no longer fit inline
+    for (auto i = 0; i < 40; i++)
+        poly.add(Vec2f(i, -i));
+
+    EXPECT_EQ(poly.size(), 40);
+
+    for (auto i = 0; i < 40; i++)
+        EXPECT_EQ(poly[i], Vec2f(i, -i));
+
+    EXPECT_EQ(poly.at(40), Vec2f(0.0f, 0.0f));
+    EXPECT_EQ(poly.bounds(), Boxf(Vec2f(0.0f, -39.0f), Vec2f(39.0f, 0.0f)));
+
+    const Polyf copy = poly;
+    EXPECT_EQ(copy.size(), 40);
+    EXPECT_EQ(copy[39], Vec2f(39.0f, -39.0f));
+
+    poly.clear();
+    EXPECT_EQ(poly.size(), 0);
+
+    poly.add(Vec2f(1.0f, 2.0f));
+    EXPECT_EQ(poly[0], Vec2f(1.0f, 2.0f));
+}
@@ -0,0 +1,77 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+#include "pool.hpp"
+
+TEST(PoolTest, Add) {
+    Pool<int, 2> pool;
+
+    for (int i = 0; i < 10; i++)
+        EXPECT_EQ(pool.add(i * 10), i);
+
+    EXPECT_EQ(pool.size(), 10);
+
+    for (int i = 0; i < 10; i++)
+        EXPECT_EQ(pool[i], i * 10);
+}
+
+TEST(PoolTest, Allocate) {
+    Pool<int, 2> pool;
+    pool.add(1);
+
+    // Ranges can span more than one chunk
+    auto first = pool.allocate(6);
+    EXPECT_EQ(first, 1);
+    EXPECT_EQ(pool.size(), 7);
+
+    for (int i = 0; i < 6; i++)
+        pool[first + i] = i;
+
+    EXPECT_EQ(pool[0], 1);
+    for (int i = 0; i < 6; i++)
+        EXPECT_EQ(pool[first + i], i);
+}
+
+TEST(PoolTest, Stable) {
+    Pool<int, 2> pool;
+
+    // Items never move as the pool grows
+    auto index = pool.add(5);
+    auto *item = &pool[index];
+
+    for (int i = 0; i < 100; i++)
+        pool.add(i);
+
+    EXPECT_EQ(item, &pool[index]);
+    EXPECT_EQ(*item, 5);
+}
+
+TEST(PoolTest, Clear) {
+    Pool<int, 2> pool;
+
+    for (int i = 0; i < 10; i++)
+        pool.add(i + 1);
+
+    pool.clear();
+    EXPECT_EQ(pool.size(), 0);
+
+    // The chunks get reused, but what was in them doesn't
+    auto first = pool.allocate(10);
+    EXPECT_EQ(first, 0);
+
+    for (int i = 0; i < 10; i++)
+        EXPECT_EQ(pool[i], 0);
+}
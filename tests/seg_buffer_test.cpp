@@ -0,0 +1,110 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+#include "seg_buffer.hpp"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    struct Result {
+        std::vector<std::uint64_t> sides;
+        std::vector<int> counts;
+
+        bool operator==(const Result &other) const {
+            return sides == other.sides && counts == other.counts;
+        }
+    };
+
+    // Classifies and counts every block against every splitter with the instruction set in use
+    template <typename Predicate>
+    Result classify_all(const SegPool &seg_pool, const std::vector<unsigned int> &segs, const SegBuffer &buffer) {
+        Result result;
+        SegBuffer::VertexSides vertex_sides;
+
+        for (auto index : segs) {
+            Splitter splitter(seg_pool[index]);
+            vertex_sides.reset();
+
+            for (std::size_t block = 0; block < buffer.blocks(); block++) {
+                auto sides = buffer.classify<Predicate>(splitter, block);
+                result.sides.insert(result.sides.end(), { sides.front, sides.back, sides.split });
+
+                auto counts = buffer.count<Predicate>(splitter, block, index, vertex_sides);
+                result.counts.insert(result.counts.end(), { counts.front, counts.back, counts.split });
+            }
+        }
+
+        return result;
+    }
+}
+
+// Every kernel has to give the same sides as the scalar one, or the tree would depend on the CPU
+TEST(SegBufferTest, InstructionSetsMatchScalar) {
+    std::mt19937 engine(1);
+    auto coord = [&]() { return static_cast<float>(static_cast<int>(engine() % 4001) - 2000); };
+
+    SegPool seg_pool;
+    std::vector<unsigned int> segs;
+
+    for (int i = 0; i < 300; i++) {
+        Vec2f p1(coord(), coord()), p2;
+
+        // Mix in axis-aligned segs and ones on the same lines as others, going both ways
+        switch (engine() % 4) {
+        case 0:  p2 = Vec2f(p1.x, coord()); break;
+        case 1:  p2 = Vec2f(coord(), p1.y); break;
+        case 2:
+            if (!segs.empty()) {
+                const auto &other = seg_pool[segs[engine() % segs.size()]];
+                int scale = static_cast<int>(engine() % 5) - 2;
+
+                p1 = other.p1();
+                p2 = Vec2f(p1.x + other.dx() * (scale ? scale : 1), p1.y + other.dy() * (scale ? scale : 1));
+                break;
+            }
+            [[fallthrough]];
+        default: p2 = Vec2f(coord(), coord()); break;
+        }
+
+        if (p1 == p2)
+            continue;
+
+        segs.push_back(seg_pool.add(Seg(p1, p2, false, 0, i)));
+    }
+
+    SegBuffer buffer;
+    buffer.assign(seg_pool, segs);
+
+    auto sets = SegBuffer::instruction_sets();
+    ASSERT_EQ(sets.back(), "Scalar");
+
+    std::string original = SegBuffer::instruction_set();
+
+    ASSERT_TRUE(SegBuffer::use_instruction_set("Scalar"));
+    auto expected_exact = classify_all<ExactPredicate>(seg_pool, segs, buffer);
+    auto expected_float = classify_all<FloatPredicate>(seg_pool, segs, buffer);
+
+    for (const auto &set : sets) {
+        ASSERT_TRUE(SegBuffer::use_instruction_set(set));
+
+        EXPECT_TRUE(classify_all<ExactPredicate>(seg_pool, segs, buffer) == expected_exact) << set << " exact";
+        EXPECT_TRUE(classify_all<FloatPredicate>(seg_pool, segs, buffer) == expected_float) << set << " float";
+    }
+
+    SegBuffer::use_instruction_set(original);
+    EXPECT_FALSE(SegBuffer::use_instruction_set("None"));
+}
@@ -59,3 +59,17 @@ TEST(SegTest, Angle) {
     EXPECT_EQ(Seg(v2, v3, false, 0.0f, 0).angle(), 0.0f);
     EXPECT_EQ(Seg(v3, v4, false, 0.0f, 0).angle(), -2826.0f);
 }
+
+TEST(SegTest, Deltas) {
+    const Seg s(Vec2f(1.0f, 2.0f), Vec2f(4.0f, -2.0f), false, 0.0f, 0);
+
+    EXPECT_EQ(s.dx(), 3.0f);
+    EXPECT_EQ(s.dy(), -4.0f);
+}
+
+TEST(SegTest, Band) {
+    // Length of 5, so points have to be a cross product of 10 or more away to be off the line
+    EXPECT_EQ(Seg(Vec2f(1.0f, 2.0f), Vec2f(4.0f, -2.0f), false, 0.0f, 0).band(), 10);
+    EXPECT_EQ(Seg::band_of(1, 1), 3);
+    EXPECT_EQ(Seg::band_of(0, 0), 0);
+}
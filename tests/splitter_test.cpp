@@ -0,0 +1,79 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+#include "splitter.hpp"
+#include <cmath>
+#include <random>
+
+namespace {
+    // A convex polygon with whole number points around a circle
+    Polyf random_polygon(std::mt19937 &engine) {
+        Polyf poly;
+        int points = 3 + engine() % 30;
+
+        for (int i = 0; i < points; i++) {
+            double angle = i * 6.283185307179586 / points;
+            poly.add(Vec2f(static_cast<int>(500 * std::cos(angle)) + static_cast<int>(engine() % 5), static_cast<int>(500 * std::sin(angle))));
+        }
+
+        return poly;
+    }
+
+    template <typename Predicate>
+    void check_clip_matches_cut() {
+        std::mt19937 engine(1);
+        Polyf scratch;
+
+        for (int i = 0; i < 20000; i++) {
+            auto poly = random_polygon(engine);
+
+            Vec2f p1(static_cast<int>(engine() % 1200) - 600, static_cast<int>(engine() % 1200) - 600);
+            Vec2f p2(static_cast<int>(engine() % 1200) - 600, static_cast<int>(engine() % 1200) - 600);
+            if (p1 == p2)
+                continue;
+
+            Splitter splitter(Seg(p1, p2, false, 0, 0));
+            auto cut = splitter.cut<Predicate>(poly);
+
+            for (int side : { -1, 1 }) {
+                Polyf clipped = poly;
+                splitter.clip<Predicate>(clipped, side, scratch);
+
+                const auto &expected = side == 1 ? cut.first : cut.second;
+                ASSERT_EQ(clipped.size(), expected.size());
+
+                for (std::size_t j = 0; j < clipped.size(); j++)
+                    ASSERT_EQ(clipped[j], expected[j]);
+            }
+        }
+    }
+}
+
+TEST(SplitterTest, ClipMatchesCutExact) {
+    check_clip_matches_cut<ExactPredicate>();
+}
+
+TEST(SplitterTest, ClipMatchesCutFloat) {
+    check_clip_matches_cut<FloatPredicate>();
+}
+
+TEST(SplitterTest, SideOf) {
+    Splitter splitter(Seg(Vec2f(0, 0), Vec2f(100, 0), false, 0, 0));
+
+    EXPECT_EQ(splitter.side_of(Vec2f(50, 10)), 1);
+    EXPECT_EQ(splitter.side_of(Vec2f(50, -10)), -1);
+    EXPECT_EQ(splitter.side_of(Vec2f(50, 0)), 0);
+}
@@ -0,0 +1,82 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+#include "thread_pool.hpp"
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+TEST(ThreadPoolTest, ParallelForCoversEveryIndexOnce) {
+    for (auto threads : { 1u, 2u, 8u }) {
+        ThreadPool pool(threads);
+
+        for (std::size_t count : { 0, 1, 7, 1000 }) {
+            std::vector<std::atomic<int>> hits(count);
+            std::vector<std::atomic<int>> chunk_hits(16);
+
+            pool.parallel_for(count, 16, [&](std::size_t begin, std::size_t end, std::size_t chunk) {
+                chunk_hits[chunk]++;
+                for (auto i = begin; i < end; i++)
+                    hits[i]++;
+            });
+
+            for (std::size_t i = 0; i < count; i++)
+                EXPECT_EQ(hits[i], 1) << threads << " threads, index " << i;
+
+            for (auto &chunk : chunk_hits)
+                EXPECT_LE(chunk, 1);
+        }
+    }
+}
+
+TEST(ThreadPoolTest, WaitRunsNestedGroups) {
+    ThreadPool pool(4);
+    std::atomic<int> total(0);
+
+    // Tasks that wait on their own groups from inside the pool, like the node builder does
+    for (int repeat = 0; repeat < 100; repeat++) {
+        ThreadPool::Group outer;
+
+        for (int i = 0; i < 8; i++) {
+            pool.run(outer, [&]() {
+                ThreadPool::Group inner;
+
+                for (int j = 0; j < 8; j++)
+                    pool.run(inner, [&]() { total++; });
+
+                pool.wait(inner);
+            });
+        }
+
+        pool.wait(outer);
+    }
+
+    EXPECT_EQ(total, 100 * 8 * 8);
+}
+
+TEST(ThreadPoolTest, WaitRethrowsErrors) {
+    ThreadPool pool(2);
+    ThreadPool::Group group;
+
+    for (int i = 0; i < 4; i++)
+        pool.run(group, [=]() { if (i == 2) throw std::runtime_error("Failed"); });
+
+    EXPECT_THROW(pool.wait(group), std::runtime_error);
+
+    // The group can be used again once the error has been reported
+    pool.run(group, []() {});
+    EXPECT_NO_THROW(pool.wait(group));
+}
@@ -0,0 +1,117 @@
+// Copyright (C) 2022 Zach Collins <zcollins4@proton.me>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <gtest/gtest.h>
+#include "wad.hpp"
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    std::string read_text(Wad &wad, const std::string &map, const std::string &name) {
+        std::size_t size;
+        auto data = wad.read_map_lump(map, name, size);
+
+        return data ? std::string(reinterpret_cast<const char*>(data.get()), size) : "(none)";
+    }
+
+    void add_text(Wad &wad, const std::string &name, const std::string &text) {
+        wad.add(name, text.data(), text.size());
+    }
+
+    // A map with only a couple of lumps, so its lumps can run up to the end of the directory
+    void add_map(Wad &wad, const std::string &name) {
+        add_text(wad, name, "");
+        add_text(wad, "THINGS", name + " things");
+        add_text(wad, "LINEDEFS", name + " linedefs");
+    }
+}
+
+// The last map's lumps can end the directory, with fewer than ten lumps after its marker
+TEST(WadTest, MapAtEndOfDirectory) {
+    Wad wad;
+    add_map(wad, "MAP01");
+
+    EXPECT_EQ(wad.maps(), std::vector<std::string>{ "MAP01" });
+    EXPECT_EQ(read_text(wad, "MAP01", "THINGS"), "MAP01 things");
+    EXPECT_EQ(read_text(wad, "MAP01", "LINEDEFS"), "MAP01 linedefs");
+    EXPECT_EQ(read_text(wad, "MAP01", "NODES"), "(none)");
+}
+
+// Maps are found up to the last one, not just the first, and lumps after the maps aren't mistaken for maps
+TEST(WadTest, FindsEveryMap) {
+    Wad wad;
+    add_text(wad, "PLAYPAL", "palette");
+    add_map(wad, "MAP01");
+    add_map(wad, "E1M1");
+    add_map(wad, "MAP02");
+    add_text(wad, "ENDOOM", "end");
+
+    EXPECT_EQ(wad.maps(), (std::vector<std::string>{ "MAP01", "E1M1", "MAP02" }));
+
+    // A map never takes the lumps of the one after it
+    for (auto map : { "MAP01", "E1M1", "MAP02" })
+        EXPECT_EQ(read_text(wad, map, "THINGS"), std::string(map) + " things");
+
+    // The same goes for a WAD read back from a file
+    auto path = std::filesystem::temp_directory_path() / ("nodebuilder_test_" + std::to_string(std::random_device()()) + ".wad");
+    ASSERT_TRUE(wad.save(path.string()));
+
+    {
+        Wad saved(path.string());
+        EXPECT_EQ(saved.maps(), (std::vector<std::string>{ "MAP01", "E1M1", "MAP02" }));
+        EXPECT_EQ(read_text(saved, "MAP02", "LINEDEFS"), "MAP02 linedefs");
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST(WadTest, NoMaps) {
+    Wad wad;
+    add_text(wad, "PLAYPAL", "palette");
+
+    EXPECT_TRUE(wad.maps().empty());
+    EXPECT_EQ(read_text(wad, "MAP01", "THINGS"), "(none)");
+}
+
+// Inserting moves the lumps around, which mustn't lose what's written to the new one
+TEST(WadTest, InsertMapLump) {
+    Wad wad;
+    add_map(wad, "MAP01");
+    add_map(wad, "MAP02");
+
+    std::vector<std::string> names = { "SIDEDEFS", "VERTEXES", "SEGS", "SSECTORS", "NODES", "SECTORS" };
+
+    for (auto map : { "MAP01", "MAP02" }) {
+        auto after = std::string("LINEDEFS");
+
+        for (const auto &name : names) {
+            auto text = std::string(map) + " " + name;
+            ASSERT_TRUE(wad.insert_map_lump(map, after, name, text.data(), text.size()));
+            after = name;
+        }
+    }
+
+    // Each lump goes after the one it was given, so every map still finds all of its own lumps
+    for (auto map : { "MAP01", "MAP02" }) {
+        EXPECT_EQ(read_text(wad, map, "THINGS"), std::string(map) + " things");
+
+        for (const auto &name : names)
+            EXPECT_EQ(read_text(wad, map, name), std::string(map) + " " + name);
+    }
+
+    EXPECT_EQ(wad.maps(), (std::vector<std::string>{ "MAP01", "MAP02" }));
+}